@@ -20,28 +20,50 @@
 #include "IRremoteInt.h"
 
 volatile irparams_t irparams;
+#ifdef IR_TX_ASYNC
+volatile irtx_t irtx;
+static ir_seqentry_t ir_holdSeq[2]; // the sequence ir_holdStart() sends
+#endif
+#ifdef IR_STATS
+volatile irstats_t irstats;
+#endif
+#ifdef IR_WAVE
+static irwave_t *ir_waveRec = 0;      // wave that ir_mark() and ir_space() record into
+static unsigned int ir_waveDropped = 0; // entries that did not fit
+static unsigned char ir_waveEncode = 0; // only record into ir_waveRec, do not send
+#endif
+#ifdef IR_TX_ASYNC
+static unsigned int ir_txDroppedAt = 0; // ir_waveDropped when the frame began
+static unsigned char ir_txRejects = 0;  // frames not queued because they did not fit
+#endif
+#ifdef IR_WAVECACHE
+static irwavecache_t ir_waveCache[IR_WAVECACHE];
+static unsigned char ir_waveNext = 0; // entry that is replaced next
+#endif
+#if IR_CHANNELS > 1
+static const unsigned char ir_channelPins[] = IR_CHANNEL_PINS;
+// does not compile unless IR_CHANNEL_PINS lists IR_CHANNELS pins
+typedef char ir_channelPinsCheck[sizeof(ir_channelPins) / sizeof(ir_channelPins[0]) == IR_CHANNELS ? 1 : -1];
+static unsigned char ir_txChannel = 0;    // channel of the next ir_send* calls
+static unsigned char ir_channelOn = 0xFF; // channel whose enable pin is high
+#endif
 
 
 void ir_sendNECRepeatFrame(void)
 {
-  ir_enableIROut(38);
-  // Disable the Timer Interrupt (which is used for receiving IR) to avoid back coupling while sending
-  TIMER_DISABLE_INTR;
+  ir_txBegin(38);
   ir_mark(NEC_HDR_MARK);
   ir_space(NEC_RPT_SPACE);
   ir_mark(NEC_BIT_MARK);
   ir_space(0);
-  // Enable the Timer Interrupt again (which is used for receiving IR)
-  TIMER_ENABLE_INTR;
+  ir_txEnd();
 }
 
 
 void ir_sendNEC(unsigned long data, int nbits)
 {
   int i = 0;
-  ir_enableIROut(38);
-  // Disable the Timer Interrupt (which is used for receiving IR) to avoid back coupling while sending
-  TIMER_DISABLE_INTR;
+  ir_txBegin(38);
 
   ir_mark(NEC_HDR_MARK);
   ir_space(NEC_HDR_SPACE);
@@ -58,15 +80,12 @@ void ir_sendNEC(unsigned long data, int nbits)
   }
   ir_mark(NEC_BIT_MARK);
   ir_space(0);
-  // Enable the Timer Interrupt again (which is used for receiving IR)
-  TIMER_ENABLE_INTR;
+  ir_txEnd();
 }
 
-void sendSony(unsigned long data, int nbits) {
+void ir_sendSony(unsigned long data, int nbits) {
   int i = 0;
-  ir_enableIROut(40);
-  // Disable the Timer Interrupt (which is used for receiving IR) to avoid back coupling while sending
-  TIMER_DISABLE_INTR;
+  ir_txBegin(40);
   ir_mark(SONY_HDR_MARK);
   ir_space(SONY_HDR_SPACE);
   data = data << (32 - nbits);
@@ -81,20 +100,18 @@ void sendSony(unsigned long data, int nbits) {
     }
     data <<= 1;
   }
-  // Enable the Timer Interrupt again (which is used for receiving IR)
-  TIMER_ENABLE_INTR;
+  ir_txEnd();
 }
 
 void ir_sendSigma(unsigned long data, int nbits) {
   int i = 0;
+  // the frame layout only fits SIGMA_BITS, see ir_codeValid()
   if (nbits != SIGMA_BITS)
   {
       return;
   }
   data = data << (32 - nbits);
-  ir_enableIROut(38);
-  // Disable the Timer Interrupt (which is used for receiving IR) to avoid back coupling while sending
-  TIMER_DISABLE_INTR;
+  ir_txBegin(38);
   ir_mark(SIGMA_HDR_MARK);
   ir_space(SIGMA_HDR_SPACE);
   for (i = 0; i < nbits; i++) {
@@ -117,16 +134,14 @@ void ir_sendSigma(unsigned long data, int nbits) {
   // the final BIT_MARK
   ir_mark(SIGMA_BIT_MARK);
   ir_space(0);
-  // Enable the Timer Interrupt again (which is used for receiving IR)
-  TIMER_ENABLE_INTR;
+  ir_txEnd();
 }
 
-void ir_sendRaw(unsigned int buf[], int len, int hz)
+// buf may be a const table in program memory, it is read from there
+void ir_sendRaw(const unsigned int buf[], int len, int hz)
 {
   int i = 0;
-  ir_enableIROut(hz);
-  // Disable the Timer Interrupt (which is used for receiving IR) to avoid back coupling while sending
-  TIMER_DISABLE_INTR;
+  ir_txBegin(hz);
   for (i = 0; i < len; i++) {
     if (i & 1) {
       ir_space(buf[i]);
@@ -136,17 +151,183 @@ void ir_sendRaw(unsigned int buf[], int len, int hz)
     }
   }
   ir_space(0); // Just to be sure
-  // Enable the Timer Interrupt again (which is used for receiving IR)
-  TIMER_ENABLE_INTR;
+  ir_txEnd();
+}
+
+// Sends a compact raw code of len bytes with its table of long durations,
+// see IR_RAW_UNIT. Both may be in program memory.
+void ir_sendRawCompact(const unsigned char buf[], int len, const unsigned int longs[], int hz)
+{
+  int i = 0;
+  ir_txBegin(hz);
+  for (i = 0; i < len; i++) {
+    if (i & 1) {
+      ir_space(ir_rawEntry(buf[i], longs) * IR_RAW_UNIT);
+    }
+    else {
+      ir_mark(ir_rawEntry(buf[i], longs) * IR_RAW_UNIT);
+    }
+  }
+  ir_space(0); // Just to be sure
+  ir_txEnd();
+}
+
+// Packs the frame of results into code (size bytes), see IR_PACKED_MAX.
+// Durations within two ticks or 1/8 of each other share a dictionary entry,
+// which holds their mean. Returns the bytes used, 0 if the frame has more
+// than IR_PACKED_MAX different durations or does not fit.
+int ir_packCapture(decode_results *results, unsigned char code[], int size)
+{
+  unsigned long sums[IR_PACKED_MAX];
+  unsigned int refs[IR_PACKED_MAX];   // first duration of each entry
+  unsigned char counts[IR_PACKED_MAX];
+  unsigned char marks = 0;            // bit k is set if entry k is a mark
+  unsigned char n = 0;
+  unsigned char bits = 0;
+  int used = 0;
+  int i = 0;
+  unsigned char k = 0;
+  unsigned char bit = 0;
+  unsigned long us = 0;
+
+  if (results->rawlen < 2 || results->rawlen - 1 > 255) {
+    return 0;
+  }
+  // collect the dictionary, entry 1 of rawbuf is a mark
+  for (i = 1; i < results->rawlen; i++) {
+    k = ir_packFind(refs, marks, n, ir_rawAt(results, i), i & 1);
+    if (k == n) {
+      if (n == IR_PACKED_MAX) {
+        return 0;
+      }
+      if (i & 1) {
+        marks |= 1 << n;
+      }
+      refs[n] = ir_rawAt(results, i);
+      sums[n] = 0;
+      counts[n] = 0;
+      n++;
+    }
+    sums[k] += ir_rawAt(results, i);
+    counts[k]++;
+  }
+  bits = n > 4 ? 3 : 2;
+  used = 2 + 2 * n + ((results->rawlen - 1) * bits + 7) / 8;
+  if (used > size) {
+    return 0;
+  }
+  code[0] = n;
+  code[1] = results->rawlen - 1;
+  for (k = 0; k < n; k++) {
+    us = (sums[k] * USECPERTICK + counts[k] / 2) / counts[k];
+    if (marks & (1 << k)) {
+      us = us > MARK_EXCESS ? us - MARK_EXCESS : 0;
+    }
+    else {
+      us += MARK_EXCESS;
+    }
+    if (us > 0xFFFF) {
+      us = 0xFFFF;
+    }
+    code[2 + 2 * k] = (unsigned char)(us >> 8);
+    code[3 + 2 * k] = (unsigned char)us;
+  }
+  // the indices, least significant bits first
+  for (i = 2 + 2 * n; i < used; i++) {
+    code[i] = 0;
+  }
+  used = (2 + 2 * n) * 8;
+  for (i = 1; i < results->rawlen; i++) {
+    k = ir_packFind(refs, marks, n, ir_rawAt(results, i), i & 1);
+    for (bit = 0; bit < bits; bit++, used++) {
+      if (k & (1 << bit)) {
+        code[used >> 3] |= 1 << (used & 7);
+      }
+    }
+  }
+  return (used + 7) / 8;
+}
+
+// Returns the dictionary entry of a mark or space, n if there is none
+static unsigned char ir_packFind(const unsigned int refs[], unsigned char marks, unsigned char n, unsigned int ticks, unsigned char mark)
+{
+  unsigned char k = 0;
+  unsigned int diff = 0;
+  for (k = 0; k < n; k++) {
+    if (((marks >> k) & 1) != mark) {
+      continue;
+    }
+    diff = ticks > refs[k] ? ticks - refs[k] : refs[k] - ticks;
+    if (diff <= 2 || diff <= refs[k] / 8) {
+      return k;
+    }
+  }
+  return n;
+}
+
+// Sends a code packed by ir_packCapture(), the indices are unpacked while
+// sending. code may be in program memory.
+void ir_sendPacked(const unsigned char code[], int hz)
+{
+  unsigned char n = code[0];
+  unsigned char len = code[1];
+  unsigned char bits = n > 4 ? 3 : 2;
+  const unsigned char *packed = code + 2 + 2 * n;
+  unsigned int pos = 0;
+  unsigned char i = 0;
+  unsigned char bit = 0;
+  unsigned char k = 0;
+  unsigned int time = 0;
+
+  ir_txBegin(hz);
+  for (i = 0; i < len; i++) {
+    k = 0;
+    for (bit = 0; bit < bits; bit++, pos++) {
+      if (packed[pos >> 3] & (1 << (pos & 7))) {
+        k |= 1 << bit;
+      }
+    }
+    if (k >= n) {
+      break;
+    }
+    time = ((unsigned int)code[2 + 2 * k] << 8) | code[3 + 2 * k];
+    if (i & 1) {
+      ir_space(time);
+    }
+    else {
+      ir_mark(time);
+    }
+  }
+  ir_space(0); // Just to be sure
+  ir_txEnd();
+}
+
+// Sends a received frame again, durations are read with ir_rawAt().
+// Entry 0 (the gap before the frame) is skipped and the sensor lag of
+// MARK_EXCESS is taken out again, marks shorter than that are sent as 0.
+void ir_sendCapture(decode_results *results, int hz)
+{
+  int i = 0;
+  unsigned int time = 0;
+  ir_txBegin(hz);
+  for (i = 1; i < results->rawlen; i++) {
+    if (i & 1) {
+      time = ir_rawAt(results, i) * USECPERTICK;
+      ir_mark(time > MARK_EXCESS ? time - MARK_EXCESS : 0);
+    }
+    else {
+      ir_space(ir_rawAt(results, i) * USECPERTICK + MARK_EXCESS);
+    }
+  }
+  ir_space(0); // Just to be sure
+  ir_txEnd();
 }
 
 // Note: first bit must be a one (start bit)
-void sendRC5(unsigned long data, int nbits)
+void ir_sendRC5(unsigned long data, int nbits)
 {
   int i = 0;
-  ir_enableIROut(36);
-  // Disable the Timer Interrupt (which is used for receiving IR) to avoid back coupling while sending
-  TIMER_DISABLE_INTR;
+  ir_txBegin(36);
   data = data << (32 - nbits);
   ir_mark(RC5_T1); // First start bit
   ir_space(RC5_T1); // Second start bit
@@ -163,18 +344,15 @@ void sendRC5(unsigned long data, int nbits)
     data <<= 1;
   }
   ir_space(0); // Turn off at end
-  // Enable the Timer Interrupt again (which is used for receiving IR)
-  TIMER_ENABLE_INTR;
+  ir_txEnd();
 }
 
 // Caller needs to take care of flipping the toggle bit
-void sendRC6(unsigned long data, int nbits)
+void ir_sendRC6(unsigned long data, int nbits)
 {
   int t = 0;
   int i = 0;
-  ir_enableIROut(36);
-  // Disable the Timer Interrupt (which is used for receiving IR) to avoid back coupling while sending
-  TIMER_DISABLE_INTR;
+  ir_txBegin(36);
   data = data << (32 - nbits);
   ir_mark(RC6_HDR_MARK);
   ir_space(RC6_HDR_SPACE);
@@ -201,14 +379,11 @@ void sendRC6(unsigned long data, int nbits)
     data <<= 1;
   }
   ir_space(0); // Turn off at end
-  // Enable the Timer Interrupt again (which is used for receiving IR)
-  TIMER_ENABLE_INTR;
+  ir_txEnd();
 }
-void sendPanasonic(unsigned int address, unsigned long data) {
+void ir_sendPanasonic(unsigned int address, unsigned long data) {
     int i=0;
-    ir_enableIROut(35);
-    // Disable the Timer Interrupt (which is used for receiving IR) to avoid back coupling while sending
-    TIMER_DISABLE_INTR;
+    ir_txBegin(35);
     ir_mark(PANASONIC_HDR_MARK);
     ir_space(PANASONIC_HDR_SPACE);
     
@@ -233,15 +408,12 @@ void sendPanasonic(unsigned int address, unsigned long data) {
     }
     ir_mark(PANASONIC_BIT_MARK);
     ir_space(0);
-    // Enable the Timer Interrupt again (which is used for receiving IR)
-    TIMER_ENABLE_INTR;
+    ir_txEnd();
 }
-void sendJVC(unsigned long data, int nbits, int repeat)
+void ir_sendJVC(unsigned long data, int nbits, int repeat)
 {
     int i = 0;
-    ir_enableIROut(38);
-    // Disable the Timer Interrupt (which is used for receiving IR) to avoid back coupling while sending
-    TIMER_DISABLE_INTR;
+    ir_txBegin(38);
     data = data << (32 - nbits);
     if (!repeat){
         ir_mark(JVC_HDR_MARK);
@@ -260,25 +432,96 @@ void sendJVC(unsigned long data, int nbits, int repeat)
     }
     ir_mark(JVC_BIT_MARK);
     ir_space(0);
-    // Enable the Timer Interrupt again (which is used for receiving IR)
-    TIMER_ENABLE_INTR;
+    ir_txEnd();
 }
 
 static void ir_mark(int time) {
   // Sends an IR mark for the specified number of microseconds.
   // The mark output is modulated at the PWM frequency.
+#ifdef IR_WAVE
+  if (ir_waveRec) {
+    ir_waveAppend(ir_waveRec, 1, (unsigned int)time);
+    return;
+  }
+#endif
+#ifdef IR_TX_ASYNC
+  // the frame has no queue slot, see ir_txBegin()
+#else
   TIMER_ENABLE_PWM; // Enable PWM output
-  ir_delayMicroseconds(time);
+  IR_STATS_TX_US(time);
+  ir_delayMicroseconds((unsigned int)time);
+#endif
 }
 
 /* Leave pin off for time (given in microseconds) */
 static void ir_space(int time) {
   // Sends an IR space for the specified number of microseconds.
   // A space is no output, so the PWM output is disabled.
+#ifdef IR_WAVE
+  if (ir_waveRec) {
+    ir_waveAppend(ir_waveRec, 0, (unsigned int)time);
+    return;
+  }
+#endif
+#ifdef IR_TX_ASYNC
+  // the frame has no queue slot, see ir_txBegin()
+#else
+  TIMER_DISABLE_PWM; // Disable PWM output
+  IR_STATS_TX_US(time);
+  ir_delayMicroseconds((unsigned int)time);
+#endif
+}
+
+/* Leave pin off for time (given in milliseconds), e.g. between two frames */
+static void ir_pause(unsigned int time) {
+#ifdef IR_WAVE
+  if (ir_waveRec) {
+    ir_waveAppend(ir_waveRec, 0, (unsigned long)time * 1000);
+    return;
+  }
+#endif
+#ifdef IR_TX_ASYNC
+  // the frame has no queue slot, see ir_txBegin()
+#else
   TIMER_DISABLE_PWM; // Disable PWM output
-  ir_delayMicroseconds(time);
+  IR_STATS_TX_US((unsigned long)time * 1000);
+  ir_delay(time);
+#endif
+}
+
+// Sets the carrier duty cycle in percent (1 to 100) for the next frames
+void ir_setCarrierDuty(unsigned char percent) {
+  if (percent < 1) {
+    percent = 1;
+  }
+  else if (percent > 100) {
+    percent = 100;
+  }
+  carrier_duty = percent;
+  carrier_khz = 0; // set up again
+}
+
+// Computes the Timer2 and CCP1 setup for a carrier of khz and carrier_duty,
+// the backends only write it to the registers. The smallest prescale (1, 4,
+// 16) that fits gives the finest PR2.
+static void ir_carrierCfg(ircarrier_t *cfg, unsigned char khz) {
+  unsigned long hz = khz * 1000UL;
+  unsigned int duty = 0;
+  for (cfg->ckps = 0; ; cfg->ckps++) {
+    cfg->steps = (unsigned int)((SYSCLOCK / (1UL << (2 * cfg->ckps)) + hz / 2) / hz);
+    if (cfg->steps <= 256 || cfg->ckps == 2) {
+      break;
+    }
+  }
+  if (cfg->steps > 256) {
+    cfg->steps = 256; // slowest carrier Timer2 can make
+  }
+  // CCP1CON<5:4> stay 0, so CCPR1L=0 is off and 255 is 100% at PR2 255
+  duty = (cfg->steps * carrier_duty + 50) / 100;
+  cfg->duty = duty > 255 ? 255 : (unsigned char)duty;
 }
 
+#ifndef IR_TX_ASYNC
 static void ir_enableIROut(int khz) {
   // Enables IR output.  The khz value controls the modulation frequency in kilohertz.
   // This routine is designed for 36-40KHz; if you use it for other values, it's up to you
@@ -291,21 +534,757 @@ static void ir_enableIROut(int khz) {
   ir_digitalWrite(TIMER_PWM_PIN, LOW); // When not sending PWM, we want it low
   ir_timerCfgKhz(khz);
 }
+#endif
+
+#if IR_CHANNELS > 1
+// Selects the channel of the next ir_send* calls
+void ir_setChannel(unsigned char channel) {
+  if (channel < IR_CHANNELS) {
+    ir_txChannel = channel;
+  }
+}
+
+// Sets the enable pin of the channel high and the ones of the others low.
+// The carrier is off while it switches.
+static void ir_channelSelect(unsigned char channel) {
+  unsigned char i;
+  if (channel == ir_channelOn) {
+    return;
+  }
+  for (i = 0; i < IR_CHANNELS; i++) {
+    ir_pinMode(ir_channelPins[i], OUTPUT);
+    ir_digitalWrite(ir_channelPins[i], i == channel);
+  }
+  ir_channelOn = channel;
+}
+#endif
+
+// Starts sending a frame with a carrier of khz
+static void ir_txBegin(int khz) {
+#ifdef IR_WAVE
+  if (ir_waveEncode) {
+    // only record the frame
+    ir_waveStart(ir_waveRec, khz);
+    return;
+  }
+#endif
+#ifdef IR_TX_ASYNC
+  ir_waveRec = ir_txSlot();
+  ir_txDroppedAt = ir_waveDropped;
+  if (ir_waveRec) {
+    ir_waveStart(ir_waveRec, khz);
+  }
+#else
+  ir_enableIROut(khz);
+#if IR_CHANNELS > 1
+  ir_channelSelect(ir_txChannel);
+#endif
+  // Mute the receiver (IR_TX_LISTEN: mask our own marks) to avoid back coupling while sending
+  TX_RX_MUTE;
+  IR_STATS_TX_FRAME();
+#endif
+}
+
+// Ends the frame started by ir_txBegin()
+static void ir_txEnd(void) {
+#ifdef IR_WAVE
+  if (ir_waveEncode) {
+    return;
+  }
+#endif
+#ifdef IR_TX_ASYNC
+  if (!ir_waveRec || ir_waveDropped != ir_txDroppedAt) {
+    // no free slot while a key is held, or the frame does not fit in a
+    // slot, it is not sent in part
+    ir_txRejects++;
+  }
+  else {
+    ir_txQueue((const irwave_t *)ir_waveRec);
+  }
+  ir_waveRec = 0;
+#else
+  ir_delayStop();
+  // Unmute the receiver again
+  TX_RX_UNMUTE;
+#endif
+}
+
+#ifdef IR_WAVE
+// Waveforms
+// A frame as Timer1 reload values, so sending it needs no arithmetic:
+// entry i is a mark if bit i of marks is set. Adjacent marks or spaces are
+// merged, a long one takes several entries.
+static const unsigned char ir_waveBit[8] = {
+  0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80
+};
+
+static void ir_waveStart(irwave_t *wave, int khz) {
+  wave->khz = khz;
+  wave->len = 0;
+}
+
+// Appends a mark (level 1) or space of time microseconds.
+// Entries that do not fit are dropped and counted.
+static void ir_waveAppend(irwave_t *wave, unsigned char level, unsigned long time) {
+  unsigned int part = 0;
+  unsigned char last = wave->len - 1;
+  while (time > 0) {
+    part = time > TX_CHUNK ? TX_CHUNK : (unsigned int)time;
+    time -= part;
+    if (part < DELAY_MIN_US) {
+      part = DELAY_MIN_US;
+    }
+    if (wave->len > 0 &&
+        ((wave->marks[last >> 3] & ir_waveBit[last & 7]) != 0) == level &&
+        (unsigned int)(0u - wave->reload[last]) <= (TX_CHUNK - part) * DELAY_TICKS_PER_US) {
+      // continues the previous entry
+      wave->reload[last] -= part * DELAY_TICKS_PER_US;
+      continue;
+    }
+    if (wave->len == IR_TXBUF) {
+      ir_waveDropped++;
+      return;
+    }
+    last = wave->len++;
+    if (level) {
+      wave->marks[last >> 3] |= ir_waveBit[last & 7];
+    }
+    else {
+      wave->marks[last >> 3] &= ~ir_waveBit[last & 7];
+    }
+    wave->reload[last] = IR_RELOAD(part);
+  }
+}
+
+// Records the waveform of code into wave, returns 0 if it can not be sent.
+// With repeat set NEC and JVC codes are recorded in their repeat form.
+// May run in the transmit interrupt, so the recording state is restored.
+static int ir_waveEncodeCode(irwave_t *wave, const ir_code_t *code, unsigned char repeat) {
+  irwave_t *rec = ir_waveRec;
+  unsigned char encode = ir_waveEncode;
+  int ok = 1;
+  ir_waveRec = wave;
+  ir_waveEncode = 1;
+  if (repeat && code->decode_type == NEC) {
+    ir_sendNECRepeatFrame();
+  }
+  else if (repeat && code->decode_type == JVC) {
+    ir_sendJVC(code->value, code->bits, 1);
+  }
+  else {
+    ok = ir_sendCode(code);
+  }
+  ir_waveEncode = encode;
+  ir_waveRec = rec;
+  return ok;
+}
+
+#ifdef IR_TX_ASYNC
+// Returns the length of wave in microseconds
+static unsigned long ir_waveLength(const irwave_t *wave) {
+  unsigned long ticks = 0;
+  unsigned char i = 0;
+  for (i = 0; i < wave->len; i++) {
+    ticks += (unsigned int)(0u - wave->reload[i]);
+  }
+  return ticks / DELAY_TICKS_PER_US;
+}
+#endif
+
+#ifndef IR_TX_ASYNC
+// Sends a waveform, returns when it is done
+static void ir_sendWave(const irwave_t *wave) {
+  unsigned char i = 0;
+  ir_pinMode(TIMER_PWM_PIN, OUTPUT);
+  ir_digitalWrite(TIMER_PWM_PIN, LOW); // When not sending PWM, we want it low
+  ir_timerCfgKhz(wave->khz);
+#if IR_CHANNELS > 1
+  ir_channelSelect(ir_txChannel);
+#endif
+  // Mute the receiver (IR_TX_LISTEN: mask our own marks) to avoid back coupling while sending
+  TX_RX_MUTE;
+  IR_STATS_TX_FRAME();
+  for (i = 0; i < wave->len; i++) {
+    if (wave->marks[i >> 3] & ir_waveBit[i & 7]) {
+      TIMER_ENABLE_PWM;
+    }
+    else {
+      TIMER_DISABLE_PWM;
+    }
+    IR_STATS_TX_RELOAD(wave->reload[i]);
+    ir_delayReload(wave->reload[i]);
+  }
+  TIMER_DISABLE_PWM;
+  ir_delayStop();
+  // Unmute the receiver again
+  TX_RX_UNMUTE;
+}
+#endif
+#endif
+
+#ifdef IR_TX_ASYNC
+// Transmit queue
+// Each slot refers to the waveform to send, its own one for frames built
+// by ir_txBegin() or a cached one. The Timer1 interrupt sends the queued
+// waveforms one after the other. Like the receive ring this is a single
+// producer / single consumer queue: head is only written by the
+// application, tail and pos only by the ISR.
+
+// Returns the waveform of the head slot, waits while all IR_TXQUEUE
+// slots are in use. Returns 0 if they are in use while a key of
+// ir_holdStart() is held, the queue does not move on until it is released.
+static irwave_t *ir_txSlot(void) {
+  while ((unsigned char)(irtx.head - irtx.tail) == IR_TXQUEUE) {
+    if (irtx.seqhold) {
+      return 0;
+    }
+    IR_WAIT();
+  }
+  return (irwave_t *)&irtx.wave[irtx.head & TXQUEUE_MASK];
+}
+
+// Queues a waveform and starts sending if idle
+static void ir_txQueue(const irwave_t *wave) {
+  if (wave->len == 0) {
+    return;
+  }
+  irtx.send[irtx.head & TXQUEUE_MASK] = wave;
+#if IR_CHANNELS > 1
+  irtx.chan[irtx.head & TXQUEUE_MASK] = ir_txChannel;
+#endif
+  // the frame has to be complete before head makes it visible
+  IR_BARRIER();
+  irtx.head++;
+  if (!irtx.busy) {
+    irtx.busy = 1;
+    // Mute the receiver (IR_TX_LISTEN: mask our own marks) to avoid back coupling while sending
+    TX_RX_MUTE;
+    ir_pinMode(TIMER_PWM_PIN, OUTPUT);
+    ir_digitalWrite(TIMER_PWM_PIN, LOW); // When not sending PWM, we want it low
+    ir_timerCfgKhz(irtx.send[irtx.tail & TXQUEUE_MASK]->khz);
+    ir_txTimerCfg();
+    irtx.pos = 0;
+    ir_txService();
+  }
+}
+
+// Timer1 interrupt code to send the queued frames
+// Each interrupt ends the current entry and starts the next one. After
+// the last entry of the last frame the receiver is enabled again.
+static void ir_txService(void)
+{
+  unsigned char slot = irtx.tail & TXQUEUE_MASK;
+  const irwave_t *wave;
+  unsigned char pos = irtx.pos;
+
+#if IR_CHANNELS > 1
+  if (irtx.lend) {
+    slot = irtx.lend - 1;
+  }
+#endif
+  wave = irtx.send[slot];
+  if (pos == wave->len) {
+    TIMER_DISABLE_PWM;
+#if IR_CHANNELS > 1
+    if (irtx.lend) {
+      // the frame sent in the gap has ended, the gap goes on
+      irtx.chan[slot] = TX_CHANNEL_SENT;
+      irtx.lend = 0;
+      slot = irtx.tail & TXQUEUE_MASK;
+      wave = irtx.send[slot];
+      pos = wave->len;
+      irtx.pos = pos;
+    }
+#endif
+    if (irtx.seq && slot == irtx.seqslot) {
+      switch (ir_seqService()) {
+        case SEQ_WAIT:
+          return;
+#if IR_CHANNELS > 1
+        case SEQ_LEND:
+          ir_delayStart();
+          slot = irtx.lend - 1;
+          wave = irtx.send[slot];
+          pos = 0;
+          break;
+#endif
+        case SEQ_FRAME:
+          // the frame starts again, without the delay of the gap interrupt
+          ir_delayStart();
+          pos = 0;
+          break;
+      }
+    }
+  }
+  if (pos == wave->len) {
+    irtx.tail++;
+#if IR_CHANNELS > 1
+    // skip the frames already sent in the gaps of a sequence
+    while (irtx.tail != irtx.head && irtx.chan[irtx.tail & TXQUEUE_MASK] == TX_CHANNEL_SENT) {
+      irtx.tail++;
+    }
+#endif
+    irtx.pos = 0;
+    if (irtx.tail == irtx.head) {
+      // queue is empty
+      ir_txTimerStop();
+      irtx.busy = 0;
+      // Unmute the receiver again
+      TX_RX_UNMUTE;
+      if (irtx.callback) {
+        irtx.callback();
+      }
+      return;
+    }
+    slot = irtx.tail & TXQUEUE_MASK;
+    wave = irtx.send[slot];
+    pos = 0;
+  }
+  if (pos == 0) {
+    // only does something if the carrier or the channel changes
+    ir_timerCfgKhz(wave->khz);
+#if IR_CHANNELS > 1
+    ir_channelSelect(irtx.chan[slot]);
+#endif
+    IR_STATS_TX_FRAME();
+  }
+  if (wave->marks[pos >> 3] & ir_waveBit[pos & 7]) {
+    TIMER_ENABLE_PWM;
+  }
+  else {
+    TIMER_DISABLE_PWM;
+  }
+  IR_STATS_TX_RELOAD(wave->reload[pos]);
+  ir_delayAdd(wave->reload[pos]);
+  irtx.pos = pos + 1;
+}
+
+// Number of frames that are queued or sent right now
+unsigned char ir_txPending(void) {
+  return irtx.head - irtx.tail;
+}
+
+// Waits until all queued frames are sent. Returns 0 at once while a key of
+// ir_holdStart() is held, the queue does not run empty until it is released.
+unsigned char ir_txWait(void) {
+  while (irtx.busy) {
+    if (irtx.seqhold) {
+      return 0;
+    }
+    IR_WAIT();
+  }
+  return 1;
+}
+
+// callback is called from the interrupt when the queue has run empty
+void ir_txSetCallback(void (*callback)(void)) {
+  irtx.callback = callback;
+}
+
+// Number of marks and spaces dropped because a frame did not fit in IR_TXBUF
+unsigned int ir_txGetOverruns(void) {
+  return ir_waveDropped;
+}
+#endif
+
+// Returns 1 if ir_sendCode() can send code
+static int ir_codeValid(const ir_code_t *code) {
+  switch (code->decode_type) {
+    case NEC:
+    case SONY:
+    case RC5:
+    case RC6:
+    case DISH:
+    case SHARP:
+    case PANASONIC:
+      return 1;
+    case SIGMA:
+      return code->bits == SIGMA_BITS; // ir_sendSigma() sends nothing else
+    case JVC:
+      return code->value != REPEAT;
+  }
+  return 0;
+}
+
+// Sends a code with the sender of its protocol
+// Returns 0 if the protocol can not be sent or, with IR_TX_ASYNC, if the
+// frame does not fit in a queue slot.
+int ir_sendCode(const ir_code_t *code) {
+#ifdef IR_TX_ASYNC
+  unsigned char rejects = ir_txRejects;
+#endif
+  if (!ir_codeValid(code)) {
+    return 0;
+  }
+  switch (code->decode_type) {
+    case NEC:
+      if (code->value == REPEAT) {
+        ir_sendNECRepeatFrame();
+      }
+      else {
+        ir_sendNEC(code->value, code->bits);
+      }
+      break;
+    case SONY:
+      ir_sendSony(code->value, code->bits);
+      break;
+    case RC5:
+      ir_sendRC5(code->value, code->bits);
+      break;
+    case RC6:
+      ir_sendRC6(code->value, code->bits);
+      break;
+    case DISH:
+      ir_sendDISH(code->value, code->bits);
+      break;
+    case SHARP:
+      ir_sendSharp(code->value, code->bits);
+      break;
+    case PANASONIC:
+      ir_sendPanasonic(code->address, code->value);
+      break;
+    case JVC:
+      ir_sendJVC(code->value, code->bits, 0);
+      break;
+    case SIGMA:
+      ir_sendSigma(code->value, code->bits);
+      break;
+  }
+#ifdef IR_TX_ASYNC
+  return rejects == ir_txRejects;
+#else
+  return 1;
+#endif
+}
+
+#ifdef IR_WAVECACHE
+// Waveform cache
+// The first ir_sendCached() of a code runs its sender once to record the
+// waveform, later ones only replay it. When the cache is full the entry
+// that was filled first is replaced.
+
+// Sends a code from the cache, returns 0 if the protocol can not be sent
+// or, with IR_TX_ASYNC, if the frame does not fit in IR_TXBUF or can not be
+// queued while a key of ir_holdStart() is held (all slots in use, or a miss
+// that has to wait for the queue to run empty)
+int ir_sendCached(const ir_code_t *code) {
+  unsigned char i = 0;
+  unsigned int dropped = 0;
+  irwavecache_t *entry;
+
+  for (i = 0; i < IR_WAVECACHE; i++) {
+    entry = &ir_waveCache[i];
+    if (entry->valid &&
+        entry->code.decode_type == code->decode_type &&
+        entry->code.value == code->value &&
+        entry->code.bits == code->bits &&
+        entry->code.address == code->address) {
+      break;
+    }
+  }
+  if (i == IR_WAVECACHE) {
+    // miss, record the waveform into the oldest entry
+    entry = &ir_waveCache[ir_waveNext];
+    ir_waveNext = (ir_waveNext + 1) % IR_WAVECACHE;
+#ifdef IR_TX_ASYNC
+    // the entry may still be queued
+    if (!ir_txWait()) {
+      return 0;
+    }
+#endif
+    entry->valid = 0;
+    dropped = ir_waveDropped;
+    if (!ir_waveEncodeCode(&entry->wave, code, 0)) {
+      return 0;
+    }
+    if (dropped != ir_waveDropped) {
+#ifdef IR_TX_ASYNC
+      // does not fit, a queue slot has the same size
+      return 0;
+#else
+      // does not fit, send it the normal way
+      ir_waveDropped = dropped;
+      return ir_sendCode(code);
+#endif
+    }
+    entry->code = *code;
+    entry->valid = 1;
+  }
+#ifdef IR_TX_ASYNC
+  if (!ir_txSlot()) {
+    return 0;
+  }
+  ir_txQueue(&entry->wave);
+#else
+  ir_sendWave(&entry->wave);
+#endif
+  return 1;
+}
+
+// Empties the cache, queued entries are still sent as they are
+void ir_clearCache(void) {
+  unsigned char i = 0;
+  for (i = 0; i < IR_WAVECACHE; i++) {
+    ir_waveCache[i].valid = 0;
+  }
+}
+#endif
+
+#ifdef IR_TX_ASYNC
+// Sequences
+// A sequence is sent from one queue slot. Its frames are recorded into
+// the waveform of that slot one entry at a time: the next entry is
+// recorded by the interrupt during the gap after the current one, so
+// gaps shorter than that take longer. The Timer1 interrupt sends the
+// gaps in pieces of TX_CHUNK.
+
+// Sends count entries one after the other without blocking. entries has
+// to stay valid until done is called from the interrupt. Waits while
+// another sequence runs. Returns 0 and sends nothing if an entry can not
+// be sent or does not fit in IR_TXBUF, or while a key is held.
+int ir_sendSequence(const ir_seqentry_t *entries, unsigned char count, void (*done)(void)) {
+  if (count == 0) {
+    return 0;
+  }
+  return ir_seqStart(entries, count, 0, done);
+}
+
+// Sends code and repeats it like a held key until ir_holdStop(): NEC
+// repeat frames every 110ms, JVC frames without header every 60ms, Sony
+// frames every 45ms (at least three). The periods run from frame start to
+// frame start. Returns 0 for other protocols or while a key is held.
+int ir_holdStart(const ir_code_t *code) {
+  unsigned long period = 0;
+  unsigned char times = 1;
+
+  switch (code->decode_type) {
+    case NEC:
+      period = NEC_RPT_LENGTH;
+      break;
+    case JVC:
+      period = JVC_RPT_LENGTH;
+      break;
+    case SONY:
+      period = SONY_RPT_LENGTH;
+      times = 2;
+      break;
+    default:
+      return 0;
+  }
+  if (code->value == REPEAT || irtx.seqhold) {
+    return 0;
+  }
+  while (irtx.seq) {
+    IR_WAIT();
+  }
+  ir_holdSeq[0].code = *code;
+  ir_holdSeq[0].times = 1;
+  ir_holdSeq[0].gap = 0;
+  ir_holdSeq[1] = ir_holdSeq[0];
+  ir_holdSeq[1].times = times;
+  return ir_seqStart(ir_holdSeq, 2, period, 0);
+}
+
+// Releases the key of ir_holdStart(), the current repeat is completed
+void ir_holdStop(void) {
+  irtx.seqhold = 0;
+}
+
+// Starts a sequence or hold, period is 0 for a sequence. Every entry is
+// recorded once before, returns 0 without sending anything if one can not
+// be sent or does not fit in IR_TXBUF.
+static int ir_seqStart(const ir_seqentry_t *entries, unsigned char count, unsigned long period, void (*done)(void)) {
+  irwave_t *wave;
+  unsigned int dropped = ir_waveDropped;
+  unsigned char i = count;
+  while (irtx.seq) {
+    if (irtx.seqhold) {
+      return 0;
+    }
+    IR_WAIT();
+  }
+  wave = ir_txSlot();
+  if (!wave) {
+    return 0;
+  }
+  // the slot is not queued yet, the last entry recorded is the first one
+  // the entries after the first of a hold are repeats
+  while (i-- > 0) {
+    if (!ir_codeValid(&entries[i].code) ||
+        !ir_waveEncodeCode(wave, &entries[i].code, period != 0 && i > 0) ||
+        dropped != ir_waveDropped) {
+      ir_waveDropped = dropped;
+      return 0;
+    }
+  }
+  irtx.seqslot = irtx.head & TXQUEUE_MASK;
+  irtx.seqleft = count;
+  irtx.seqtimes = entries[0].times ? entries[0].times : 1;
+  irtx.seqgap = 0;
+  irtx.seqperiod = period;
+  irtx.seqhold = period != 0;
+  irtx.seqframe = period ? ir_waveLength(wave) : 0;
+  irtx.seqstate = SEQ_FRAME;
+  irtx.seqdone = done;
+  irtx.seq = entries;
+  ir_txQueue(wave);
+  return 1;
+}
+
+// Returns 1 while a sequence runs
+unsigned char ir_seqBusy(void) {
+  return irtx.seq != 0;
+}
+
+// Continues the sequence at the end of a frame or a piece of its gap.
+// Returns SEQ_WAIT if a piece of the gap is running, SEQ_FRAME if the
+// frame in the slot has to be sent (again) or SEQ_DONE at the end.
+static unsigned char ir_seqService(void)
+{
+  unsigned int part = 0;
+
+  if (irtx.seqstate != SEQ_GAP) {
+    // a frame has ended
+    if (irtx.seqperiod) {
+      irtx.seqgap = irtx.seqperiod > irtx.seqframe ? irtx.seqperiod - irtx.seqframe : 0;
+    }
+    else {
+      irtx.seqgap = irtx.seq->gap * 1000UL;
+    }
+    irtx.seqstate = SEQ_GAP;
+    if (irtx.seqhold && irtx.seqleft == 1 && irtx.seqtimes == 1) {
+      // the key is still held, repeat the last entry
+    }
+    else if (--irtx.seqtimes == 0 && --irtx.seqleft > 0) {
+      irtx.seq++;
+      irtx.seqtimes = irtx.seq->times ? irtx.seq->times : 1;
+      irtx.seqstate = SEQ_NEXT;
+    }
+  }
+  if (irtx.seqstate == SEQ_NEXT) {
+    // the slot is free until the gap has ended
+    // the entries after the first of a hold are repeats
+    ir_waveEncodeCode((irwave_t *)&irtx.wave[irtx.seqslot], &irtx.seq->code, irtx.seqperiod != 0);
+    irtx.pos = irtx.wave[irtx.seqslot].len; // still at the end of the frame
+    if (irtx.seqperiod) {
+      irtx.seqframe = ir_waveLength((const irwave_t *)&irtx.wave[irtx.seqslot]);
+    }
+    irtx.seqstate = SEQ_GAP;
+  }
+#if IR_CHANNELS > 1
+  if (ir_seqLend()) {
+    return SEQ_LEND;
+  }
+#endif
+  if (irtx.seqgap > 0) {
+    part = irtx.seqgap > TX_CHUNK ? TX_CHUNK : (unsigned int)irtx.seqgap;
+    irtx.seqgap -= part;
+    ir_delayAdd(IR_RELOAD(part));
+    return SEQ_WAIT;
+  }
+  if (irtx.seqleft == 0) {
+    irtx.seq = 0;
+    if (irtx.seqdone) {
+      irtx.seqdone();
+    }
+    return SEQ_DONE;
+  }
+  irtx.seqstate = SEQ_FRAME;
+  return SEQ_FRAME;
+}
+#if IR_CHANNELS > 1
+// Lets the next queued frame be sent in the gap of the sequence if it is
+// for another channel and fits into the rest of the gap. Only the next
+// frame is looked at, so the frames still leave in their queued order.
+// Its slot is freed when the sequence has ended, so while a key is held
+// the ir_send* functions return 0 once all slots are in use, see
+// ir_txSlot().
+static unsigned char ir_seqLend(void)
+{
+  unsigned char next = irtx.tail;
+  unsigned char slot;
+  unsigned long len;
+
+  do {
+    if (++next == irtx.head) {
+      return 0;
+    }
+    slot = next & TXQUEUE_MASK;
+  } while (irtx.chan[slot] == TX_CHANNEL_SENT);
+  if (irtx.chan[slot] == irtx.chan[irtx.seqslot]) {
+    return 0;
+  }
+  len = ir_waveLength(irtx.send[slot]);
+  if (len > irtx.seqgap) {
+    return 0;
+  }
+  irtx.seqgap -= len;
+  irtx.lend = slot + 1;
+  return 1;
+}
+#endif
+#endif
 
 // initialization
 void ir_enableIRIn(void) {
+#ifdef IR_STREAM_DECODE
+  unsigned char slot = 0;
+#endif
   irparams.recvpin = IR_RECEIVE_PIN;
   irparams.blinkflag = 0;
   // initialize state machine variables
   irparams.rcvstate = STATE_IDLE;
   irparams.rawlen = 0;
+  irparams.head = 0;
+  irparams.tail = 0;
+  irparams.peak = 0;
+  irparams.overflows = 0;
+  irparams.rawcur = irparams.rawbuf[0];
+#ifdef IR_RAWBUF_COMPACT
+  irparams.longcur = irparams.rawlongs[0];
+#endif
+#ifdef IR_RX_FOLLOW
+  irparams.endnow = 0;
+#endif
+#ifdef IR_TX_LISTEN
+  irparams.txecho = 0;
+  irparams.txactive = 0;
+  irparams.collisions = 0;
+#endif
+#ifdef IR_STATS
+  irstats.overflowbase = 0;
+#endif
+#ifdef IR_EARLY_END
+  irparams.endcount = 0;
+  irparams.endgap = GAP_TICKS;
+#endif
+#ifdef IR_STREAM_DECODE
+  irparams.stream.count = 0;
+  irparams.stream.done = 0;
+  for (slot = 0; slot < RAWFRAMES; slot++) {
+    irparams.streamres[slot].decode_type = UNKNOWN;
+  }
+#endif
   // set pin modes
   ir_pinMode(irparams.recvpin, INPUT);
   
   DISABLE_INTERRUPTS;
+#if IR_RX_BACKEND == IR_RX_EDGE
+  // setup free running timer for edge time stamps and the gap timeout
+  ir_timerCfgEdge();
+  irparams.rcvlevel = SPACE;
+  irparams.timer = 0;
+  irparams.lastedge = 0;
+  ir_edgeArm(EDGE_IDLE_TICKS);
+#else
   // setup pulse clock timer interrupt for Timer
   ir_timerCfgNorm();
   ir_timerRst();
+#endif
+#ifdef IR_STATS
+  // time base of the interrupt duration
+  ir_statsTimerCfg();
+#endif
 
   //Timer2 Overflow Interrupt Enable
   TIMER_ENABLE_INTR;
@@ -322,6 +1301,28 @@ void ir_blink13(int blinkflag)
     ir_pinMode(BLINKLED_PIN, OUTPUT);
 }
 
+// call this function inside your InterruptServiceHigh()
+void ir_interruptService(void)
+{
+#ifdef IR_STATS
+  unsigned int start = ir_statsTimerRead();
+#endif
+#ifdef IR_TX_ASYNC
+  if (TX_INT_PENDING) {
+    ir_txService();
+  }
+#endif
+  ir_rxService();
+#ifdef IR_STATS
+  start = ir_statsTimerRead() - start;
+  if (start > irstats.isrMax) {
+    irstats.isrMax = start;
+  }
+  irstats.isrCalls++;
+#endif
+}
+
+#if IR_RX_BACKEND == IR_RX_POLL
 // TIMER interrupt code to collect raw data.
 // Widths of alternating SPACE, MARK are recorded in rawbuf.
 // Recorded in ticks of 50 microseconds.
@@ -329,25 +1330,40 @@ void ir_blink13(int blinkflag)
 // First entry is the SPACE between transmissions.
 // As soon as a SPACE gets long, ready is set, state switches to IDLE, timing of SPACE continues.
 // As soon as first MARK arrives, gap width is recorded, ready is cleared, and new logging starts
-
-// call this function inside your InterruptServiceHigh()
-void ir_interruptService(void)
+static void ir_rxService(void)
 {
   unsigned char irdata = 0;
 
   // timer is used for sampling IR signal
-  if (TIMER_INT_FLAG == 1)
+  if (TIMER_INT_PENDING)
   {
     TIMER_INT_FLAG = 0;
 
     ir_timerRst();
 
     irdata = (unsigned char)ir_digitalRead(irparams.recvpin);
+#ifdef IR_TX_LISTEN
+    if (irparams.txecho) {
+      // our own mark or its tail in the detector output
+      if (irparams.txecho != TX_ECHO_MARK) {
+        irparams.txecho--;
+      }
+      irdata = SPACE;
+    }
+    else if (irdata == MARK && irparams.txactive == TX_SENDING) {
+      // a foreign mark while we send
+      irparams.collisions++;
+      irparams.txactive = TX_COLLIDED;
+    }
+#endif
 
     irparams.timer++; // One more 50us tick
+    if (irparams.rcvstate == STATE_STOP) {
+        ir_frameCheckFree();
+    }
     if (irparams.rawlen >= RAWBUF) {
-        // Buffer overflow
-        irparams.rcvstate = STATE_STOP;
+        // Buffer overflow, hand over what we have
+        ir_frameDone(IR_END_FULL);
     }
     switch(irparams.rcvstate) {
       case STATE_IDLE: // In the middle of a gap
@@ -359,7 +1375,7 @@ void ir_interruptService(void)
         else {
             // gap just ended, record duration and start recording transmission
             irparams.rawlen = 0;
-            irparams.rawbuf[irparams.rawlen++] = irparams.timer;
+            ir_rxStore(irparams.timer);
             irparams.timer = 0;
             irparams.rcvstate = STATE_MARK;
         }
@@ -367,33 +1383,42 @@ void ir_interruptService(void)
         break;
       case STATE_MARK: // timing MARK
         if (irdata == SPACE) {   // MARK ended, record time
-            irparams.rawbuf[irparams.rawlen++] = irparams.timer;
+            ir_rxStore(irparams.timer);
             irparams.timer = 0;
             irparams.rcvstate = STATE_SPACE;
         }
         break;
       case STATE_SPACE: // timing SPACE
         if (irdata == MARK) { // SPACE just ended, record it
-            irparams.rawbuf[irparams.rawlen++] = irparams.timer;
+            ir_rxStore(irparams.timer);
             irparams.timer = 0;
             irparams.rcvstate = STATE_MARK;
         } 
         else { // SPACE
-          if (irparams.timer > GAP_TICKS) {
+          if (irparams.timer > SPACE_END_TICKS) {
             // big SPACE, indicates gap between codes
             // Mark current code as ready for processing
-            // Switch to STOP
             // Don't reset timer; keep counting space width
-            irparams.rcvstate = STATE_STOP;
+            ir_frameDone(SPACE_END_REASON);
           } 
         }
         break;
-     case STATE_STOP: // waiting, measuring gap
+     case STATE_STOP: // all frame slots in use, measuring gap
         if (irdata == MARK) { // reset gap timer
+           if (irparams.timer >= GAP_TICKS) {
+             // a new frame started and there is no room for it
+             irparams.overflows++;
+           }
            irparams.timer = 0;
         }
         break;
     }
+#ifdef IR_RX_FOLLOW
+    if (irparams.endnow) {
+      // the last entry completed the frame, no need to wait for the gap
+      ir_frameDone(irparams.endnow);
+    }
+#endif
 
     if (irparams.blinkflag) {
         if (irdata == MARK) {
@@ -406,372 +1431,606 @@ void ir_interruptService(void)
   }
 }
 
-void ir_resume(void) {
-  irparams.rcvstate = STATE_IDLE;
-  irparams.rawlen = 0;
-}
+#else
+// Port change interrupt code to collect raw data.
+// Same recording scheme as the polling code above, but the ISR only runs
+// once per detector edge. The duration since the previous edge is taken from
+// the free running Timer3 and rounded to 50 microsecond ticks, instead of
+// being counted by sampling every tick.
+// CCP2 compares against Timer3: it ends the frame after GAP_TICKS without
+// an edge and afterwards keeps the gap measurement going in steps of
+// EDGE_IDLE_TICKS, so a long gap costs a few interrupts instead of thousands.
+static void ir_rxService(void)
+{
+  unsigned char irdata = 0;
+  unsigned int now = 0;
+  unsigned int duration = 0;
+
+  if (EDGE_TIMEOUT_PENDING) {
+    EDGE_TIMEOUT_FLAG = 0;
+    // No edge up to the compare point, account the elapsed time
+    irparams.timer += irparams.armticks;
+    irparams.lastedge += irparams.armticks * EDGE_TMR_PER_TICK;
+    if (irparams.rcvstate == STATE_SPACE) {
+      // big SPACE, indicates gap between codes
+      // Mark current code as ready for processing
+      ir_frameDone(SPACE_END_REASON);
+    }
+    if (irparams.timer < EDGE_IDLE_LIMIT) {
+      ir_edgeArm(EDGE_IDLE_TICKS);
+    }
+    else {
+      // Gap is saturated, stop measuring until the next edge
+      EDGE_TIMEOUT_DISABLE;
+    }
+  }
 
+  if (EDGE_INT_PENDING)
+  {
+    now = ir_edgeTimerRead();
+    // reading the port ends the mismatch condition
+    irdata = (unsigned char)ir_digitalRead(irparams.recvpin);
+    EDGE_INT_FLAG = 0;
 
+    if (irdata == irparams.rcvlevel) {
+      // Change on another RB pin or a glitch shorter than the interrupt latency
+      return;
+    }
+    irparams.rcvlevel = irdata;
 
-// Decodes the received IR message
-// Returns 0 if no data ready, 1 if data ready.
-// Results of decoding are stored in results
-int ir_decode(decode_results *results) {
-  results->rawlen = irparams.rawlen;
-  results->rawbuf = (volatile unsigned int *)&irparams.rawbuf[0];
-  if (irparams.rcvstate != STATE_STOP) {
-    return ERR;
-  }
-  if (ir_decodeSigma(results)) {
-     return DECODED;
-  }
-  if (ir_decodeNEC(results)) {
-    return DECODED;
-  }
-  if (ir_decodeSony(results)) {
-    return DECODED;
-  }
-  if (ir_decodeSanyo(results)) {
-    return DECODED;
-  }
-  if (ir_decodeMitsubishi(results)) {
-    return DECODED;
-  }
-  if (ir_decodeRC5(results)) {
-    return DECODED;
-  }
-  if (ir_decodeRC6(results)) {
-    return DECODED;
-  }
-  if (ir_decodePanasonic(results)) {
-     return DECODED;
-  }
-  if (ir_decodeJVC(results)) {
-     return DECODED;
-  }
+    if (irparams.timer >= EDGE_IDLE_LIMIT) {
+      duration = irparams.timer;
+    }
+    else {
+      duration = irparams.timer + EDGE_TO_TICKS(now - irparams.lastedge);
+    }
+    irparams.lastedge = now;
+    irparams.timer = 0;
 
-  // decodeHash returns a hash on any input.
-  // Thus, it needs to be last in the list.
-  // If you add any decodes, add them before this.
-  if (ir_decodeHash(results)) {
-    return DECODED;
-  }
-  // Throw away and start over
-  ir_resume();
-  return ERR;
-}
+    if (irparams.rcvstate == STATE_STOP) {
+        ir_frameCheckFree();
+    }
+    if (irparams.rawlen >= RAWBUF) {
+        // Buffer overflow, hand over what we have
+        ir_frameDone(IR_END_FULL);
+    }
+    switch(irparams.rcvstate) {
+      case STATE_IDLE: // In the middle of a gap
+        if (irdata == MARK && duration >= GAP_TICKS) {
+            // gap just ended, record duration and start recording transmission
+            irparams.rawlen = 0;
+            ir_rxStore(duration);
+            irparams.rcvstate = STATE_MARK;
+        }
+        break;
+      case STATE_MARK: // timing MARK
+        if (irdata == SPACE) {   // MARK ended, record time
+            ir_rxStore(duration);
+            irparams.rcvstate = STATE_SPACE;
+        }
+        break;
+      case STATE_SPACE: // timing SPACE
+        if (irdata == MARK) { // SPACE just ended, record it
+            ir_rxStore(duration);
+            irparams.rcvstate = STATE_MARK;
+        }
+        break;
+     case STATE_STOP: // all frame slots in use, measuring gap
+        if (irdata == MARK && duration >= GAP_TICKS) {
+            // a new frame started and there is no room for it
+            irparams.overflows++;
+        }
+        break;
+    }
+#ifdef IR_RX_FOLLOW
+    if (irparams.endnow) {
+      // the last entry completed the frame, no need to wait for the gap
+      ir_frameDone(irparams.endnow);
+    }
+#endif
 
-// NECs have a repeat only 4 items long
-static long ir_decodeNEC(decode_results *results) {
-  int i = 0;
-  long data = 0;
-  int offset = 1; // Skip first space
-  // Initial mark
-  if (!MATCH_MARK(results->rawbuf[offset], NEC_HDR_MARK)) {
-    return ERR;
-  }
-  offset++;
-  // Check for repeat
-  if (irparams.rawlen == 4 &&
-    MATCH_SPACE(results->rawbuf[offset], NEC_RPT_SPACE) &&
-    MATCH_MARK(results->rawbuf[offset+1], NEC_BIT_MARK)) {
-    results->bits = 0;
-    results->value = REPEAT;
-    results->decode_type = NEC;
-    return DECODED;
-  }
-  if (irparams.rawlen < 2 * NEC_BITS + 4) {
-    return ERR;
+    if (irparams.rcvstate == STATE_SPACE) {
+      // end of frame if the space gets longer than a gap
+      ir_edgeArm(SPACE_END_TICKS + 1);
+    }
+    else {
+      ir_edgeArm(EDGE_IDLE_TICKS);
+    }
+
+    if (irparams.blinkflag) {
+        if (irdata == MARK) {
+            BLINKLED_ON(); 
+        } 
+        else {
+            BLINKLED_OFF(); 
+        }
+    }
   }
-  // Initial space  
-  if (!MATCH_SPACE(results->rawbuf[offset], NEC_HDR_SPACE)) {
-    return ERR;
+}
+#endif
+
+#ifdef IR_RAWBUF_COMPACT
+// Compact raw buffer: durations below RAW_ESC ticks (12.35ms) are stored
+// in one byte. Longer ones (the gap in entry 0 and rare long spaces) go to
+// the rawlong table of the frame and the byte holds RAW_ESC + their index.
+// If more than RAWLONG long durations occur, the rest is clipped to
+// RAW_ESC - 1, which is still longer than any mark or space we decode.
+static void ir_rawStore(unsigned int ticks)
+{
+  if (irparams.rawlen == 0) {
+    irparams.longlen = 0;
   }
-  offset++;
-  for (i = 0; i < NEC_BITS; i++) {
-    if (!MATCH_MARK(results->rawbuf[offset], NEC_BIT_MARK)) {
-      return ERR;
+  if (ticks >= RAW_ESC) {
+    if (irparams.longlen < RAWLONG) {
+      irparams.longcur[irparams.longlen] = ticks;
+      ticks = RAW_ESC + irparams.longlen;
+      irparams.longlen++;
     }
-    offset++;
-    if (MATCH_SPACE(results->rawbuf[offset], NEC_ONE_SPACE)) {
-      data = (data << 1) | 1;
-    } 
-    else if (MATCH_SPACE(results->rawbuf[offset], NEC_ZERO_SPACE)) {
-      data <<= 1;
-    } 
     else {
-      return ERR;
+      ticks = RAW_ESC - 1;
     }
-    offset++;
   }
-  // Success
-  results->bits = NEC_BITS;
-  results->value = data;
-  results->decode_type = NEC;
-  return DECODED;
+  irparams.rawcur[irparams.rawlen++] = (rawbuf_t)ticks;
 }
 
+// Returns entry index of a received frame in ticks
+unsigned int ir_rawAt(decode_results *results, int index)
+{
+  return ir_rawEntry(results->rawbuf[index], results->rawlong);
+}
+#endif
 
-// SIGMA ASC 333
-static long ir_decodeSigma(decode_results *results) {
-  int i = 0;
-  long data = 0;
-  int offset = 1; // Skip first space
-  // Initial mark
-  if (!MATCH_MARK(results->rawbuf[offset], SIGMA_HDR_MARK)) {
-    return ERR;
+#ifdef IR_RX_FOLLOW
+// Records an entry and follows the frame with it
+static void ir_rxStore(unsigned int ticks)
+{
+  ir_rawStore(ticks);
+#ifdef IR_EARLY_END
+  ir_endEdge(ticks);
+#endif
+#ifdef IR_STREAM_DECODE
+  ir_streamEdge(ticks);
+#endif
+}
+#endif
+
+// Frame handoff between the ISR and ir_decode()/ir_resume()
+// This is a single producer / single consumer ring: head is only written by
+// the ISR, tail only by the application. Both run freely and are reduced
+// to a slot with RAWFRAMES_MASK, so head - tail is the number of received
+// frames. A slot between tail and head belongs to the application and is
+// not touched by the ISR, so no interrupts need to be disabled.
+
+// Called by the ISR when the frame in the head slot is complete.
+// Publishes the slot and continues with the next free one.
+// If all slots are in use the receiver stops until ir_resume() frees one.
+static void ir_frameDone(unsigned char reason)
+{
+  unsigned char pending = 0;
+  irparams.rawlens[irparams.head & RAWFRAMES_MASK] = irparams.rawlen;
+  irparams.endreasons[irparams.head & RAWFRAMES_MASK] = reason;
+#ifdef IR_STATS
+  if (reason == IR_END_FULL) {
+    irstats.rawFull++;
   }
-  offset++;
-
-  
-  if (irparams.rawlen < 2 * SIGMA_BITS + 6) {
-    return ERR;
+#endif
+  // the frame has to be complete before head makes it visible
+  IR_BARRIER();
+  irparams.head++;
+  pending = irparams.head - irparams.tail;
+  if (pending > irparams.peak) {
+    irparams.peak = pending;
   }
-  
-  // Initial space
-  if (!MATCH_SPACE(results->rawbuf[offset], SIGMA_HDR_SPACE)) {
-    return ERR;
+  irparams.rawlen = 0;
+#ifdef IR_RX_FOLLOW
+  irparams.endnow = 0;
+#endif
+#ifdef IR_STREAM_DECODE
+  irparams.stream.count = 0;
+  irparams.stream.done = 0;
+#endif
+#ifdef IR_EARLY_END
+  irparams.endcount = 0;
+  irparams.endgap = GAP_TICKS;
+#endif
+  irparams.rawcur = irparams.rawbuf[irparams.head & RAWFRAMES_MASK];
+#ifdef IR_RAWBUF_COMPACT
+  irparams.longcur = irparams.rawlongs[irparams.head & RAWFRAMES_MASK];
+#endif
+  if (pending == RAWFRAMES) {
+    irparams.rcvstate = STATE_STOP;
   }
-  offset++;
-
-  //first byte
-  for (i = 0; i < SIGMA_BITS; i++) {
-    if (!MATCH_MARK(results->rawbuf[offset], SIGMA_BIT_MARK)) {
-      return ERR;
-    }
-    offset++;
-    if (MATCH_SPACE(results->rawbuf[offset], SIGMA_ONE_SPACE)) {
-      data = (data << 1) | 1;
-    }
-    else if (MATCH_SPACE(results->rawbuf[offset], SIGMA_ZERO_SPACE)) {
-      data <<= 1;
-    }
-    else {
-      return ERR;
-    }
-    offset++;
+  else {
+    irparams.rcvstate = STATE_IDLE;
+  }
+}
 
-    // between the two bytes is an extra space
-    if (i == 7)
-    {
-        // next space
-        if (!MATCH_MARK(results->rawbuf[offset], SIGMA_BIT_MARK)) {
-            return ERR;
-        }
-        offset++;
-        if (!MATCH_SPACE(results->rawbuf[offset], SIGMA_NEXT_SPACE)) {
-            return ERR;
-        }
-        offset++;
-    }
+// Called by the ISR in STATE_STOP, returns to IDLE once ir_resume()
+// has freed a slot.
+static void ir_frameCheckFree(void)
+{
+  if ((unsigned char)(irparams.head - irparams.tail) < RAWFRAMES) {
+    irparams.rcvstate = STATE_IDLE;
   }
+}
 
-  //final mark bit
-  if (!MATCH_MARK(results->rawbuf[offset], SIGMA_BIT_MARK)) {
-    return ERR;
+// Releases the oldest received frame, so its slot can be reused.
+void ir_resume(void) {
+  if (irparams.tail != irparams.head) {
+    // done with the slot before it is handed back
+    IR_BARRIER();
+    irparams.tail++;
   }
+}
 
-  // Success
-  results->bits = 2 * SIGMA_BITS;
-  results->value = data;
-  results->decode_type = SIGMA;
-  return DECODED;
+// Number of frames lost because all RAWFRAMES slots were in use
+unsigned int ir_getOverflowCount(void) {
+  unsigned int overflows = 0;
+  // the ISR may change the counter between the two byte reads
+  do {
+    overflows = irparams.overflows;
+  } while (overflows != irparams.overflows);
+  return overflows - irparams.overflowbase;
 }
 
+// Highest number of frames that were waiting for ir_decode() at once
+unsigned char ir_getFramesPeak(void) {
+  return irparams.peak;
+}
 
-static long ir_decodeSony(decode_results *results) {
-  long data = 0;
-  int offset = 0; // Dont skip first space, check its size
-  if (irparams.rawlen < 2 * SONY_BITS + 2) {
-    return ERR;
+#ifdef IR_TX_LISTEN
+// Number of sends during which a foreign mark was received
+unsigned int ir_getCollisions(void) {
+  unsigned int collisions = 0;
+  // the ISR may change the counter between the two byte reads
+  do {
+    collisions = irparams.collisions;
+  } while (collisions != irparams.collisions);
+  return collisions;
+}
+#endif
+void ir_resetOverflowCount(void) {
+  irparams.overflowbase += ir_getOverflowCount();
+  // may race with the ISR raising it, at worst one update is lost
+  irparams.peak = irparams.head - irparams.tail;
+}
+
+#ifdef IR_STATS
+// Copies the counters of IR_STATS, with the interrupts off so they are
+// consistent
+void ir_getStats(ir_stats_t *stats) {
+  unsigned char i = 0;
+  unsigned long ticks = 0;
+  DISABLE_INTERRUPTS;
+  stats->isrCalls = irstats.isrCalls;
+  stats->isrMaxTicks = irstats.isrMax;
+  stats->rawFull = irstats.rawFull;
+  stats->framesLost = irparams.overflows - irstats.overflowbase;
+  for (i = 0; i <= SIGMA; i++) {
+    stats->decoded[i] = irstats.decoded[i];
   }
-  
+  stats->failed = irstats.failed;
+  stats->txFrames = irstats.txFrames;
+  ticks = irstats.txTicks;
+  ENABLE_INTERRUPTS;
+  stats->txBusyUs = ticks / DELAY_TICKS_PER_US;
+}
 
-  // Some Sony's deliver repeats fast after first
-  // unfortunately can't spot difference from of repeat from two fast clicks
-  if (results->rawbuf[offset] < SONY_DOUBLE_SPACE_USECS) {
-    results->bits = 0;
-    results->value = REPEAT;
-    results->decode_type = SANYO;
-    return DECODED;
+// Sets the counters of IR_STATS to 0
+void ir_resetStats(void) {
+  unsigned char i = 0;
+  DISABLE_INTERRUPTS;
+  irstats.isrCalls = 0;
+  irstats.isrMax = 0;
+  irstats.rawFull = 0;
+  irstats.overflowbase = irparams.overflows;
+  for (i = 0; i <= SIGMA; i++) {
+    irstats.decoded[i] = 0;
   }
-  offset++;
+  irstats.failed = 0;
+  irstats.txFrames = 0;
+  irstats.txTicks = 0;
+  ENABLE_INTERRUPTS;
+}
+#endif
 
-  // Initial mark
-  if (!MATCH_MARK(results->rawbuf[offset], SONY_HDR_MARK)) {
+
+
+// Decodes the oldest received IR message
+// Returns 0 if no data ready, 1 if data ready.
+// Results of decoding are stored in results
+// The frame stays in its slot until ir_resume() is called, results->rawbuf
+// points into the slot and is stable until then.
+int ir_decode(decode_results *results) {
+  unsigned char slot = 0;
+  if (irparams.tail == irparams.head) {
     return ERR;
   }
-  offset++;
-
-  while (offset + 1 < irparams.rawlen) {
-    if (!MATCH_SPACE(results->rawbuf[offset], SONY_HDR_SPACE)) {
-      break;
-    }
-    offset++;
-    if (MATCH_MARK(results->rawbuf[offset], SONY_ONE_MARK)) {
-      data = (data << 1) | 1;
-    } 
-    else if (MATCH_MARK(results->rawbuf[offset], SONY_ZERO_MARK)) {
-      data <<= 1;
-    } 
-    else {
-      return ERR;
-    }
-    offset++;
+  // head has to be read before the frame it published
+  IR_BARRIER();
+  slot = irparams.tail & RAWFRAMES_MASK;
+  results->rawlen = irparams.rawlens[slot];
+  results->rawbuf = (rawbuf_t *)irparams.rawbuf[slot];
+  results->endReason = irparams.endreasons[slot];
+#ifdef IR_RAWBUF_COMPACT
+  results->rawlong = (unsigned int *)irparams.rawlongs[slot];
+#endif
+#ifdef IR_STREAM_DECODE
+  if (irparams.streamres[slot].decode_type != UNKNOWN) {
+    // decoded by the ISR already
+    results->decode_type = irparams.streamres[slot].decode_type;
+    results->panasonicAddress = irparams.streamres[slot].address;
+    results->value = irparams.streamres[slot].value;
+    results->bits = irparams.streamres[slot].bits;
+    IR_STATS_DECODED(results->decode_type);
+    return DECODED;
+  }
+#endif
+  IR_COUNT_DECODER(UNKNOWN);
+  if (ir_decodeSignatures(results)) {
+    IR_STATS_DECODED(results->decode_type);
+    return DECODED;
   }
+  IR_COUNT_DECODER(UNKNOWN);
 
-  // Success
-  results->bits = (offset - 1) / 2;
-  if (results->bits < 12) {
-    results->bits = 0;
-    return ERR;
+  // decodeHash returns a hash on any input.
+  // Thus, it needs to be last in the list.
+  // If you add any decodes, add them before this.
+  if (ir_decodeHash(results)) {
+    IR_STATS_DECODED(UNKNOWN);
+    return DECODED;
   }
-  results->value = data;
-  results->decode_type = SONY;
-  return DECODED;
+  // Throw away and start over
+#ifdef IR_STATS
+  irstats.failed++;
+#endif
+  ir_resume();
+  return ERR;
 }
 
+// Pulse distance / pulse width protocols
+// Each protocol is described by an irpulse_t in ROM and decoded by
+// ir_decodePulse(). A bit is a pair of a fixed duration (the bit mark of
+// NEC, the space of Sony) and a data duration that is either one or zero.
+// To support another remote of this kind add a descriptor and a row in
+// ir_signatures[], no code is needed.
+
+// NECs have a repeat only 4 items long
+static const irpulse_t ir_pulseNEC = {
+  NEC, 0,
+  2, { { TICKS_MARK(NEC_HDR_MARK) }, { TICKS_SPACE(NEC_HDR_SPACE) }, { TICKS_ANY } },
+  { TICKS_MARK(NEC_BIT_MARK) }, { TICKS_SPACE(NEC_ONE_SPACE) }, { TICKS_SPACE(NEC_ZERO_SPACE) },
+  NEC_BITS, 0, PULSE_NOSEP, { TICKS_ANY }, { TICKS_ANY },
+  2 * NEC_BITS + 4, NEC_BITS,
+  PULSE_RPT_SHORT, 4, { TICKS_SPACE(NEC_RPT_SPACE) }, 0, NEC
+};
+
+// SIGMA ASC 333
+// between the two bytes is an extra mark and space
+static const irpulse_t ir_pulseSigma = {
+  SIGMA, PULSE_STOP,
+  2, { { TICKS_MARK(SIGMA_HDR_MARK) }, { TICKS_SPACE(SIGMA_HDR_SPACE) }, { TICKS_ANY } },
+  { TICKS_MARK(SIGMA_BIT_MARK) }, { TICKS_SPACE(SIGMA_ONE_SPACE) }, { TICKS_SPACE(SIGMA_ZERO_SPACE) },
+  SIGMA_BITS, 0, 7, { TICKS_MARK(SIGMA_BIT_MARK) }, { TICKS_SPACE(SIGMA_NEXT_SPACE) },
+  2 * SIGMA_BITS + 6, SIGMA_BITS,
+  PULSE_RPT_NONE, 0, { TICKS_ANY }, 0, SIGMA
+};
+
+// Some Sony's deliver repeats fast after first
+// unfortunately can't spot difference from of repeat from two fast clicks
+static const irpulse_t ir_pulseSony = {
+  SONY, PULSE_VARLEN,
+  1, { { TICKS_MARK(SONY_HDR_MARK) }, { TICKS_ANY }, { TICKS_ANY } },
+  { TICKS_SPACE(SONY_HDR_SPACE) }, { TICKS_MARK(SONY_ONE_MARK) }, { TICKS_MARK(SONY_ZERO_MARK) },
+  SONY_BITS, 0, PULSE_NOSEP, { TICKS_ANY }, { TICKS_ANY },
+  2 * SONY_BITS + 2, 0,
+  PULSE_RPT_GAP, 0, { TICKS_ANY }, SONY_DOUBLE_SPACE_USECS, SANYO
+};
+
 // I think this is a Sanyo decoder - serial = SA 8650B
 // Looks like Sony except for timings, 48 chars of data and time/space different
-static long ir_decodeSanyo(decode_results *results) {
-  long data = 0;
-  int offset = 0; // Skip first space
-  if (irparams.rawlen < 2 * SANYO_BITS + 2) {
-    return ERR;
-  }
- 
-  // Initial space  
-  if (results->rawbuf[offset] < SANYO_DOUBLE_SPACE_USECS) {
-    results->bits = 0;
-    results->value = REPEAT;
-    results->decode_type = SANYO;
-    return DECODED;
-  }
-  offset++;
+// The header mark is seen twice
+static const irpulse_t ir_pulseSanyo = {
+  SANYO, PULSE_VARLEN,
+  2, { { TICKS_MARK(SANYO_HDR_MARK) }, { TICKS_MARK(SANYO_HDR_MARK) }, { TICKS_ANY } },
+  { TICKS_SPACE(SANYO_HDR_SPACE) }, { TICKS_MARK(SANYO_ONE_MARK) }, { TICKS_MARK(SANYO_ZERO_MARK) },
+  SANYO_BITS, 0, PULSE_NOSEP, { TICKS_ANY }, { TICKS_ANY },
+  2 * SANYO_BITS + 2, 0,
+  PULSE_RPT_GAP, 0, { TICKS_ANY }, SANYO_DOUBLE_SPACE_USECS, SANYO
+};
 
-  // Initial mark
-  if (!MATCH_MARK(results->rawbuf[offset], SANYO_HDR_MARK)) {
-    return ERR;
-  }
-  offset++;
+// Looks like Sony except for timings, 48 chars of data and time/space different
+// Typical
+// 14200 7 41 7 42 7 42 7 17 7 17 7 18 7 41 7 18 7 17 7 17 7 18 7 41 8 17 7 17 7 18 7 17 7 
+// Not seeing double keys from Mitsubishi
+static const irpulse_t ir_pulseMitsubishi = {
+  MITSUBISHI, PULSE_VARLEN | PULSE_DATA_FIRST,
+  1, { { TICKS_MARK(MITSUBISHI_HDR_SPACE) }, { TICKS_ANY }, { TICKS_ANY } },
+  { TICKS_SPACE(MITSUBISHI_HDR_SPACE) }, { TICKS_MARK(MITSUBISHI_ONE_MARK) }, { TICKS_MARK(MITSUBISHI_ZERO_MARK) },
+  MITSUBISHI_BITS, 0, PULSE_NOSEP, { TICKS_ANY }, { TICKS_ANY },
+  2 * MITSUBISHI_BITS + 2, 0,
+  PULSE_RPT_NONE, 0, { TICKS_ANY }, 0, MITSUBISHI
+};
+
+// 16 address bits followed by 32 data bits
+static const irpulse_t ir_pulsePanasonic = {
+  PANASONIC, 0,
+  2, { { TICKS_MARK(PANASONIC_HDR_MARK) }, { TICKS_MARK(PANASONIC_HDR_SPACE) }, { TICKS_ANY } },
+  { TICKS_MARK(PANASONIC_BIT_MARK) }, { TICKS_SPACE(PANASONIC_ONE_SPACE) }, { TICKS_SPACE(PANASONIC_ZERO_SPACE) },
+  PANASONIC_BITS, PANASONIC_BITS_ADR, PULSE_NOSEP, { TICKS_ANY }, { TICKS_ANY },
+  2 * PANASONIC_BITS + 3, PANASONIC_BITS,
+  PULSE_RPT_NONE, 0, { TICKS_ANY }, 0, PANASONIC
+};
+
+// JVC repeats by sending the frame without header
+static const irpulse_t ir_pulseJVC = {
+  JVC, PULSE_STOP,
+  2, { { TICKS_MARK(JVC_HDR_MARK) }, { TICKS_SPACE(JVC_HDR_SPACE) }, { TICKS_ANY } },
+  { TICKS_MARK(JVC_BIT_MARK) }, { TICKS_SPACE(JVC_ONE_SPACE) }, { TICKS_SPACE(JVC_ZERO_SPACE) },
+  JVC_BITS, 0, PULSE_NOSEP, { TICKS_ANY }, { TICKS_ANY },
+  2 * JVC_BITS + 1, JVC_BITS,
+  PULSE_RPT_NOHDR, 2 * JVC_BITS + 2, { TICKS_ANY }, 0, JVC
+};
+
+static long ir_decodePulse(decode_results *results, const irpulse_t *proto) {
+  unsigned long data = 0;
+  int offset = 1; // Skip first space
+  int rawlen = results->rawlen;
+  unsigned char flags = proto->flags;
+  unsigned char nbits = 0;
+  unsigned char i = 0;
+  unsigned int width = 0;
+  // bounds of the bit loop, kept in RAM
+  unsigned int fixedLow = proto->fixed.low;
+  unsigned int fixedHigh = proto->fixed.high;
+  unsigned int oneLow = proto->one.low;
+  unsigned int oneHigh = proto->one.high;
+  unsigned int zeroLow = proto->zero.low;
+  unsigned int zeroHigh = proto->zero.high;
 
-  // Skip Second Mark
-  if (!MATCH_MARK(results->rawbuf[offset], SANYO_HDR_MARK)) {
+  // Check for repeat
+  switch (proto->rptKind) {
+    case PULSE_RPT_SHORT: // header mark, short space and a bit mark
+      if (rawlen == proto->rptLen &&
+          ir_match(ir_rawAt(results, 1), proto->hdr[0].low, proto->hdr[0].high) &&
+          ir_match(ir_rawAt(results, 2), proto->rptSpace.low, proto->rptSpace.high) &&
+          ir_match(ir_rawAt(results, 3), fixedLow, fixedHigh)) {
+        results->bits = 0;
+        results->value = REPEAT;
+        results->decode_type = proto->rptType;
+        return DECODED;
+      }
+      break;
+    case PULSE_RPT_NOHDR: // the frame without header
+      if (rawlen == proto->rptLen &&
+          ir_match(ir_rawAt(results, 1), fixedLow, fixedHigh) &&
+          ir_match(ir_rawAt(results, rawlen - 1), fixedLow, fixedHigh)) {
+        results->bits = 0;
+        results->value = REPEAT;
+        results->decode_type = proto->rptType;
+        return DECODED;
+      }
+      break;
+    case PULSE_RPT_GAP: // any frame right after the previous one
+      if (rawlen >= proto->minLen &&
+          ir_rawAt(results, 0) < proto->rptGap) {
+        results->bits = 0;
+        results->value = REPEAT;
+        results->decode_type = proto->rptType;
+        return DECODED;
+      }
+      break;
+  }
+  if (rawlen < proto->minLen) {
     return ERR;
   }
-  offset++;
 
-  while (offset + 1 < irparams.rawlen) {
-    if (!MATCH_SPACE(results->rawbuf[offset], SANYO_HDR_SPACE)) {
-      break;
-    }
-    offset++;
-    if (MATCH_MARK(results->rawbuf[offset], SANYO_ONE_MARK)) {
-      data = (data << 1) | 1;
-    } 
-    else if (MATCH_MARK(results->rawbuf[offset], SANYO_ZERO_MARK)) {
-      data <<= 1;
-    } 
-    else {
+  for (i = 0; i < proto->hdrLen; i++) {
+    if (!ir_match(ir_rawAt(results, offset), proto->hdr[i].low, proto->hdr[i].high)) {
       return ERR;
     }
     offset++;
   }
 
-  // Success
-  results->bits = (offset - 1) / 2;
-  if (results->bits < 12) {
-    results->bits = 0;
-    return ERR;
-  }
-  results->value = data;
-  results->decode_type = SANYO;
-  return DECODED;
-}
-
-// Looks like Sony except for timings, 48 chars of data and time/space different
-static long ir_decodeMitsubishi(decode_results *results) {
-  long data = 0;
-  int offset = 0; // Skip first space
-  if (irparams.rawlen < 2 * MITSUBISHI_BITS + 2) {
-    return ERR;
-  }
-  
-  // Initial space  
-  /* Not seeing double keys from Mitsubishi
-  if (results->rawbuf[offset] < MITSUBISHI_DOUBLE_SPACE_USECS) {
-    results->bits = 0;
-    results->value = REPEAT;
-    results->decode_type = MITSUBISHI;
-    return DECODED;
-  }
-  */
-  offset++;
-
-  // Typical
-  // 14200 7 41 7 42 7 42 7 17 7 17 7 18 7 41 7 18 7 17 7 17 7 18 7 41 8 17 7 17 7 18 7 17 7 
-
-  // Initial Space
-  if (!MATCH_MARK(results->rawbuf[offset], MITSUBISHI_HDR_SPACE)) {
-    return ERR;
-  }
-  offset++;
-  while (offset + 1 < irparams.rawlen) {
-    if (MATCH_MARK(results->rawbuf[offset], MITSUBISHI_ONE_MARK)) {
+  for (nbits = 0; ; nbits++) {
+    if (flags & PULSE_VARLEN) {
+      if (offset + 1 >= rawlen) {
+        break;
+      }
+    }
+    else if (nbits == proto->nbits) {
+      break;
+    }
+    if (!(flags & PULSE_DATA_FIRST)) {
+      if (!ir_match(ir_rawAt(results, offset), fixedLow, fixedHigh)) {
+        if (flags & PULSE_VARLEN) {
+          break;
+        }
+        return ERR;
+      }
+      offset++;
+    }
+    width = ir_rawAt(results, offset);
+    if (ir_match(width, oneLow, oneHigh)) {
       data = (data << 1) | 1;
     } 
-    else if (MATCH_MARK(results->rawbuf[offset], MITSUBISHI_ZERO_MARK)) {
+    else if (ir_match(width, zeroLow, zeroHigh)) {
       data <<= 1;
     } 
     else {
       return ERR;
     }
     offset++;
-    if (!MATCH_SPACE(results->rawbuf[offset], MITSUBISHI_HDR_SPACE)) {
-      break;
+    if (flags & PULSE_DATA_FIRST) {
+      if (!ir_match(ir_rawAt(results, offset), fixedLow, fixedHigh)) {
+        if (flags & PULSE_VARLEN) {
+          break;
+        }
+        return ERR;
+      }
+      offset++;
+    }
+    if (nbits + 1 == proto->addrBits) {
+      results->panasonicAddress = (unsigned int)data;
+    }
+    if (nbits == proto->sepAfter) {
+      if (!ir_match(ir_rawAt(results, offset), proto->sepMark.low, proto->sepMark.high) ||
+          !ir_match(ir_rawAt(results, offset + 1), proto->sepSpace.low, proto->sepSpace.high)) {
+        return ERR;
+      }
+      offset += 2;
     }
-    offset++;
   }
 
-  // Success
-  results->bits = (offset - 1) / 2;
-  if (results->bits < MITSUBISHI_BITS) {
-    results->bits = 0;
-    return ERR;
+  if (flags & PULSE_VARLEN) {
+    results->bits = (offset - 1) / 2;
+    if (results->bits < proto->nbits) {
+      results->bits = 0;
+      return ERR;
+    }
   }
-  results->value = data;
-  results->decode_type = MITSUBISHI;
+  else {
+    //Stop bit
+    if ((flags & PULSE_STOP) && !ir_match(ir_rawAt(results, offset), fixedLow, fixedHigh)) {
+      return ERR;
+    }
+    results->bits = proto->resultBits;
+  }
+  // Success, a 48 bit Panasonic frame keeps the last 32 bits as on the PIC
+  results->value = data & 0xFFFFFFFFUL;
+  results->decode_type = proto->type;
   return DECODED;
 }
 
 
+static const rclevel_t ir_rc5Level = RC_LEVEL_BOUNDS(RC5_T1);
+static const rclevel_t ir_rc6Level = RC_LEVEL_BOUNDS(RC6_T1);
+
 // Gets one undecoded level at a time from the raw buffer.
 // The RC5/6 decoding is easier if the data is broken into time intervals.
 // E.g. if the buffer has MARK for 2 time intervals and SPACE for 1,
 // successive calls to getRClevel will return MARK, MARK, SPACE.
 // offset and used are updated to keep track of the current position.
-// t1 is the time interval for a single bit in microseconds.
+// t1 holds the tick bounds of the time interval for a single bit.
 // Returns -1 for error (measured time interval is not a multiple of t1).
-static int ir_getRClevel(decode_results *results, int *offset, int *used, int t1) {
-  int width = 0;
+static int ir_getRClevel(decode_results *results, int *offset, int *used, const rclevel_t *t1) {
+  unsigned int width = 0;
   int val = 0;
-  int correction = 0;
   int avail = 0;
   if (*offset >= results->rawlen) {
     // After end of recorded buffer, assume SPACE.
     return SPACE;
   }
-  width = results->rawbuf[*offset];
+  width = ir_rawAt(results, *offset);
   val = ((*offset) % 2) ? MARK : SPACE;
-  correction = (val == MARK) ? MARK_EXCESS : - MARK_EXCESS;
 
-  if (MATCH(width, t1 + correction)) {
+  if (ir_match(width, t1->low[val][0], t1->high[val][0])) {
     avail = 1;
   } 
-  else if (MATCH(width, 2*t1 + correction)) {
+  else if (ir_match(width, t1->low[val][1], t1->high[val][1])) {
     avail = 2;
   } 
-  else if (MATCH(width, 3*t1 + correction)) {
+  else if (ir_match(width, t1->low[val][2], t1->high[val][2])) {
     avail = 3;
   } 
   else {
@@ -791,18 +2050,18 @@ static long ir_decodeRC5(decode_results *results) {
   long data = 0;
   int used = 0;
   int nbits = 0;
-  if (irparams.rawlen < MIN_RC5_SAMPLES + 2) {
+  if (results->rawlen < MIN_RC5_SAMPLES + 2) {
     return ERR;
   }
 
   // Get start bits
-  if (ir_getRClevel(results, &offset, &used, RC5_T1) != MARK) return ERR;
-  if (ir_getRClevel(results, &offset, &used, RC5_T1) != SPACE) return ERR;
-  if (ir_getRClevel(results, &offset, &used, RC5_T1) != MARK) return ERR;
+  if (ir_getRClevel(results, &offset, &used, &ir_rc5Level) != MARK) return ERR;
+  if (ir_getRClevel(results, &offset, &used, &ir_rc5Level) != SPACE) return ERR;
+  if (ir_getRClevel(results, &offset, &used, &ir_rc5Level) != MARK) return ERR;
 
-  for (nbits = 0; offset < irparams.rawlen; nbits++) {
-    int levelA = ir_getRClevel(results, &offset, &used, RC5_T1);
-    int levelB = ir_getRClevel(results, &offset, &used, RC5_T1);
+  for (nbits = 0; offset < results->rawlen; nbits++) {
+    int levelA = ir_getRClevel(results, &offset, &used, &ir_rc5Level);
+    int levelB = ir_getRClevel(results, &offset, &used, &ir_rc5Level);
     if (levelA == SPACE && levelB == MARK) {
       // 1 bit
       data = (data << 1) | 1;
@@ -834,30 +2093,30 @@ static long ir_decodeRC6(decode_results *results) {
   }
   
   // Initial mark
-  if (!MATCH_MARK(results->rawbuf[offset], RC6_HDR_MARK)) {
+  if (!MATCH_MARK(ir_rawAt(results, offset), RC6_HDR_MARK)) {
     return ERR;
   }
   offset++;
-  if (!MATCH_SPACE(results->rawbuf[offset], RC6_HDR_SPACE)) {
+  if (!MATCH_SPACE(ir_rawAt(results, offset), RC6_HDR_SPACE)) {
     return ERR;
   }
   offset++;
 
   // Get start bit (1)
-  if (ir_getRClevel(results, &offset, &used, RC6_T1) != MARK) return ERR;
-  if (ir_getRClevel(results, &offset, &used, RC6_T1) != SPACE) return ERR;
+  if (ir_getRClevel(results, &offset, &used, &ir_rc6Level) != MARK) return ERR;
+  if (ir_getRClevel(results, &offset, &used, &ir_rc6Level) != SPACE) return ERR;
 
   for (nbits = 0; offset < results->rawlen; nbits++) {
     int levelA, levelB; // Next two levels
-    levelA = ir_getRClevel(results, &offset, &used, RC6_T1);
+    levelA = ir_getRClevel(results, &offset, &used, &ir_rc6Level);
     if (nbits == 3) {
       // T bit is double wide; make sure second half matches
-      if (levelA != ir_getRClevel(results, &offset, &used, RC6_T1)) return ERR;
+      if (levelA != ir_getRClevel(results, &offset, &used, &ir_rc6Level)) return ERR;
     } 
-    levelB = ir_getRClevel(results, &offset, &used, RC6_T1);
+    levelB = ir_getRClevel(results, &offset, &used, &ir_rc6Level);
     if (nbits == 3) {
       // T bit is double wide; make sure second half matches
-      if (levelB != ir_getRClevel(results, &offset, &used, RC6_T1)) return ERR;
+      if (levelB != ir_getRClevel(results, &offset, &used, &ir_rc6Level)) return ERR;
     } 
     if (levelA == MARK && levelB == SPACE) { // reversed compared to RC5
       // 1 bit
@@ -878,108 +2137,409 @@ static long ir_decodeRC6(decode_results *results) {
   return DECODED;
 }
 
-static long ir_decodePanasonic(decode_results *results) {
-    unsigned long data = 0;
-    int offset = 1;
-    int i = 0;
-    
-    if (!MATCH_MARK(results->rawbuf[offset], PANASONIC_HDR_MARK)) {
-        return ERR;
+// Decoders in the order they are tried, with the header they accept
+static const irsignature_t ir_signatures[] = {
+  { SIGMA, 0, &ir_pulseSigma, TICKS_MARK(SIGMA_HDR_MARK), TICKS_SPACE(SIGMA_HDR_SPACE),
+    2 * SIGMA_BITS + 6, SIG_NOLEN, 0 },
+  // header space of the repeat code up to the one of a full frame
+  { NEC, 0, &ir_pulseNEC, TICKS_MARK(NEC_HDR_MARK),
+    TICKS_LOW(NEC_RPT_SPACE - MARK_EXCESS), TICKS_HIGH(NEC_HDR_SPACE - MARK_EXCESS),
+    4, SIG_NOLEN, 0 },
+  { SONY, 0, &ir_pulseSony, TICKS_MARK(SONY_HDR_MARK), TICKS_SPACE(SONY_HDR_SPACE),
+    2 * SONY_BITS + 2, SIG_NOLEN, SONY_DOUBLE_SPACE_USECS },
+  { SANYO, 0, &ir_pulseSanyo, TICKS_MARK(SANYO_HDR_MARK), TICKS_MARK(SANYO_HDR_MARK),
+    2 * SANYO_BITS + 2, SIG_NOLEN, SANYO_DOUBLE_SPACE_USECS },
+  // first data bit is a zero or one mark
+  { MITSUBISHI, 0, &ir_pulseMitsubishi, TICKS_MARK(MITSUBISHI_HDR_SPACE),
+    TICKS_LOW(MITSUBISHI_ZERO_MARK + MARK_EXCESS), TICKS_HIGH(MITSUBISHI_ONE_MARK + MARK_EXCESS),
+    2 * MITSUBISHI_BITS + 2, SIG_NOLEN, 0 },
+  // start bits, one to three half bits each
+  { RC5, ir_decodeRC5, 0, TICKS_LOW(RC5_T1 + MARK_EXCESS), TICKS_HIGH(3*RC5_T1 + MARK_EXCESS),
+    TICKS_LOW(RC5_T1 - MARK_EXCESS), TICKS_HIGH(3*RC5_T1 - MARK_EXCESS),
+    MIN_RC5_SAMPLES + 2, SIG_NOLEN, 0 },
+  { RC6, ir_decodeRC6, 0, TICKS_MARK(RC6_HDR_MARK), TICKS_SPACE(RC6_HDR_SPACE),
+    MIN_RC6_SAMPLES, SIG_NOLEN, 0 },
+  // the decoder reads the header and all 48 bits
+  { PANASONIC, 0, &ir_pulsePanasonic, TICKS_MARK(PANASONIC_HDR_MARK), TICKS_MARK(PANASONIC_HDR_SPACE),
+    2 * PANASONIC_BITS + 3, SIG_NOLEN, 0 },
+  { JVC, 0, &ir_pulseJVC, TICKS_MARK(JVC_HDR_MARK), TICKS_SPACE(JVC_HDR_SPACE),
+    2 * JVC_BITS + 1, SIG_NOLEN, 0 },
+  // repeat without header
+  { JVC, 0, &ir_pulseJVC, TICKS_MARK(JVC_BIT_MARK), TICKS_ANY,
+    2 * JVC_BITS + 2, 2 * JVC_BITS + 2, 0 },
+};
+
+#define IR_SIGNATURES (sizeof(ir_signatures) / sizeof(ir_signatures[0]))
+
+// Classifies the header of the frame once and only tries the decoders
+// whose signature matches it.
+static long ir_decodeSignatures(decode_results *results) {
+  unsigned char i = 0;
+  unsigned int gap = 0;
+  unsigned int mark = 0;
+  unsigned int space = 0;
+  const irsignature_t *sig;
+
+  if (results->rawlen < 1) {
+    return ERR;
+  }
+  gap = ir_rawAt(results, 0);
+  if (results->rawlen > 1) {
+    mark = ir_rawAt(results, 1);
+  }
+  if (results->rawlen > 2) {
+    space = ir_rawAt(results, 2);
+  }
+  for (i = 0; i < IR_SIGNATURES; i++) {
+    sig = &ir_signatures[i];
+    if ((unsigned int)results->rawlen < sig->minLen || (unsigned int)results->rawlen > sig->maxLen) {
+      continue;
     }
-    offset++;
-    if (!MATCH_MARK(results->rawbuf[offset], PANASONIC_HDR_SPACE)) {
-        return ERR;
+    IR_COUNT_DECODER(sig->type);
+    if (gap >= sig->gapBelow &&
+       (!ir_match(mark, sig->markLow, sig->markHigh) ||
+        !ir_match(space, sig->spaceLow, sig->spaceHigh))) {
+      continue;
     }
-    offset++;
-    
-    // decode address
-    for (i = 0; i < PANASONIC_BITS_ADR; i++) {
-        if (!MATCH_MARK(results->rawbuf[offset++], PANASONIC_BIT_MARK)) {
-            return ERR;
-        }
-        if (MATCH_SPACE(results->rawbuf[offset],PANASONIC_ONE_SPACE)) {
-            data = (data << 1) | 1;
-        } else if (MATCH_SPACE(results->rawbuf[offset],PANASONIC_ZERO_SPACE)) {
-            data <<= 1;
-        } else {
-            return ERR;
-        }
-        offset++;
+    if (sig->pulse) {
+      if (ir_decodePulse(results, sig->pulse)) {
+        return DECODED;
+      }
     }
-    results->panasonicAddress = (unsigned int)(data);
-    // decode value
-    for (i = 0; i < PANASONIC_BITS_VAL; i++) {
-        if (!MATCH_MARK(results->rawbuf[offset++], PANASONIC_BIT_MARK)) {
-            return ERR;
-        }
-        if (MATCH_SPACE(results->rawbuf[offset],PANASONIC_ONE_SPACE)) {
-            data = (data << 1) | 1;
-        } else if (MATCH_SPACE(results->rawbuf[offset],PANASONIC_ZERO_SPACE)) {
-            data <<= 1;
-        } else {
-            return ERR;
-        }
-        offset++;
+    else if (sig->decode(results)) {
+      return DECODED;
     }
-    results->value = (unsigned long)data;
-    
-    results->decode_type = PANASONIC;
-    results->bits = PANASONIC_BITS;
-    return DECODED;
+  }
+  return ERR;
 }
 
-static long ir_decodeJVC(decode_results *results) {
-    int i = 0;
-    long data = 0;
-    int offset = 1; // Skip first space
-    // Check for repeat
-    if (irparams.rawlen - 1 == 33 &&
-        MATCH_MARK(results->rawbuf[offset], JVC_BIT_MARK) &&
-        MATCH_MARK(results->rawbuf[irparams.rawlen-1], JVC_BIT_MARK)) {
-        results->bits = 0;
-        results->value = REPEAT;
-        results->decode_type = JVC;
-        return DECODED;
-    } 
-    // Initial mark
-    if (!MATCH_MARK(results->rawbuf[offset], JVC_HDR_MARK)) {
-        return ERR;
-    }
-    offset++; 
-    if (irparams.rawlen < 2 * JVC_BITS + 1 ) {
-        return ERR;
+#ifdef IR_STREAM_DECODE
+/* -----------------------------------------------------------------------
+ * Streaming decode
+ * ir_streamEdge() is called by the ISR for every entry it records. With
+ * the header space it picks the candidates from ir_signatures[] the same
+ * way ir_decodeSignatures() would. Only fixed length pulse protocols can
+ * be followed (NEC, Sigma, Panasonic and JVC), any other decoder whose
+ * signature matches ends the list, as it would be tried first.
+ * Each further entry is checked against every candidate with the same
+ * ranges ir_decodePulse() uses. When the stop mark of a candidate arrives
+ * and no candidate before it is left, the result is stored with the slot
+ * and the ISR hands the frame over right away. If one before it is left,
+ * e.g. NEC for a JVC frame, the complete candidate waits: it is handed over
+ * once those fail, or once the space after the stop mark is longer than
+ * they accept. Another entry means the frame is longer than the candidate,
+ * then it is dropped. Otherwise the frame ends with the gap as before and
+ * ir_decode() decodes it.
+ */
+
+// Returns the candidate for the header or 0 if it can not be followed
+static unsigned char ir_streamStart(irstreamcand_t *cand, const irsignature_t *sig, unsigned int space)
+{
+  const irpulse_t *proto = sig->pulse;
+  unsigned int mark = irparams.stream.mark;
+
+  cand->proto = 0;
+  cand->nbits = 0;
+  cand->data = 0;
+  cand->address = 0;
+  if (proto->rptKind == PULSE_RPT_SHORT &&
+      ir_match(mark, proto->hdr[0].low, proto->hdr[0].high) &&
+      ir_match(space, proto->rptSpace.low, proto->rptSpace.high)) {
+    cand->phase = STREAM_RPT;
+  }
+  else if (ir_match(mark, proto->hdr[0].low, proto->hdr[0].high) &&
+           ir_match(space, proto->hdr[1].low, proto->hdr[1].high)) {
+    cand->phase = STREAM_FIXED;
+  }
+  else {
+    return 0;
+  }
+  cand->proto = proto;
+  return 1;
+}
+
+// Advances a candidate by one entry
+// Returns STREAM_DONE when the frame is complete, 0 if it did not match
+#define STREAM_RUN  1
+#define STREAM_DONE 2
+static unsigned char ir_streamStep(irstreamcand_t *cand, unsigned int ticks)
+{
+  const irpulse_t *proto = cand->proto;
+
+  switch (cand->phase) {
+    case STREAM_FIXED:
+      if (cand->nbits == proto->nbits) {
+        //Stop bit
+        if ((proto->flags & PULSE_STOP) && !ir_match(ticks, proto->fixed.low, proto->fixed.high)) {
+          return 0;
+        }
+        return STREAM_DONE;
+      }
+      if (!ir_match(ticks, proto->fixed.low, proto->fixed.high)) {
+        return 0;
+      }
+      cand->phase = STREAM_DATA;
+      return STREAM_RUN;
+    case STREAM_DATA:
+      if (ir_match(ticks, proto->one.low, proto->one.high)) {
+        cand->data = (cand->data << 1) | 1;
+      }
+      else if (ir_match(ticks, proto->zero.low, proto->zero.high)) {
+        cand->data <<= 1;
+      }
+      else {
+        return 0;
+      }
+      if (cand->nbits + 1 == proto->addrBits) {
+        cand->address = (unsigned int)cand->data;
+      }
+      if (cand->nbits == proto->sepAfter) {
+        cand->phase = STREAM_SEPMARK;
+      }
+      else {
+        cand->phase = STREAM_FIXED;
+      }
+      cand->nbits++;
+      return STREAM_RUN;
+    case STREAM_SEPMARK:
+      if (!ir_match(ticks, proto->sepMark.low, proto->sepMark.high)) {
+        return 0;
+      }
+      cand->phase = STREAM_SEPSPACE;
+      return STREAM_RUN;
+    case STREAM_SEPSPACE:
+      if (!ir_match(ticks, proto->sepSpace.low, proto->sepSpace.high)) {
+        return 0;
+      }
+      cand->phase = STREAM_FIXED;
+      return STREAM_RUN;
+    case STREAM_RPT:
+      if (!ir_match(ticks, proto->fixed.low, proto->fixed.high)) {
+        return 0;
+      }
+      cand->nbits = 0;
+      cand->data = REPEAT;
+      return STREAM_DONE;
+  }
+  return 0;
+}
+
+// Stores the result of a complete candidate with the slot that is recorded
+static void ir_streamPublish(irstreamcand_t *cand)
+{
+  volatile irstreamresult_t *res = &irparams.streamres[irparams.head & RAWFRAMES_MASK];
+  const irpulse_t *proto = cand->proto;
+
+  if (cand->phase == STREAM_RPT) {
+    res->decode_type = proto->rptType;
+    res->bits = 0;
+  }
+  else {
+    res->decode_type = proto->type;
+    res->bits = proto->resultBits;
+  }
+  res->value = cand->data & 0xFFFFFFFFUL;
+  res->address = cand->address;
+  irparams.stream.count = 0;
+  irparams.stream.done = 0;
+  irparams.endnow = IR_END_STREAM;
+}
+
+// Returns the longest entry a running candidate accepts next, GAP_TICKS
+// if that is a mark
+static unsigned int ir_streamBound(const irstreamcand_t *cand)
+{
+  const irpulse_t *proto = cand->proto;
+
+  switch (cand->phase) {
+    case STREAM_DATA:
+      return proto->one.high > proto->zero.high ? proto->one.high : proto->zero.high;
+    case STREAM_SEPSPACE:
+      return proto->sepSpace.high;
+  }
+  return GAP_TICKS;
+}
+
+// Called by the ISR when the space gets longer than SPACE_END_TICKS
+// Returns the IR_END_* reason the frame ends for
+static unsigned char ir_streamGap(void)
+{
+  if (irparams.stream.done) {
+    // no candidate before the complete one accepts this space
+    ir_streamPublish((irstreamcand_t *)&irparams.stream.cand[irparams.stream.done - 1]);
+    return IR_END_STREAM;
+  }
+  return IR_END_GAP;
+}
+
+// Called by the ISR with each entry it records (rawbuf[rawlen - 1])
+static void ir_streamEdge(unsigned int ticks)
+{
+  unsigned int index = irparams.rawlen - 1;
+  unsigned char i = 0;
+  unsigned char alive = 0;
+  const irsignature_t *sig;
+  irstreamcand_t *cand;
+
+  if (index == 0) {
+    irparams.stream.gap = ticks;
+    irparams.stream.count = 0;
+    irparams.stream.done = 0;
+    irparams.streamres[irparams.head & RAWFRAMES_MASK].decode_type = UNKNOWN;
+    return;
+  }
+  if (index == 1) {
+    irparams.stream.mark = ticks;
+    return;
+  }
+  if (index == 2) {
+    for (i = 0; i < IR_SIGNATURES; i++) {
+      sig = &ir_signatures[i];
+      if (irparams.stream.gap >= sig->gapBelow &&
+         (!ir_match(irparams.stream.mark, sig->markLow, sig->markHigh) ||
+          !ir_match(ticks, sig->spaceLow, sig->spaceHigh))) {
+        continue;
+      }
+      if (!sig->pulse || sig->maxLen != SIG_NOLEN || sig->pulse->hdrLen != 2 ||
+          (sig->pulse->flags & (PULSE_VARLEN | PULSE_DATA_FIRST)) ||
+          irparams.stream.count == STREAM_CANDIDATES) {
+        // ir_decode() tries this decoder before the ones that follow
+        break;
+      }
+      cand = (irstreamcand_t *)&irparams.stream.cand[irparams.stream.count];
+      irparams.stream.count += ir_streamStart(cand, sig, ticks);
     }
-    // Initial space 
-    if (!MATCH_SPACE(results->rawbuf[offset], JVC_HDR_SPACE)) {
-        return ERR;
+    return;
+  }
+
+  if (irparams.stream.done) {
+    // the frame goes on after the complete candidate
+    irparams.stream.count = irparams.stream.done - 1;
+    irparams.stream.done = 0;
+  }
+  for (i = 0; i < irparams.stream.count; i++) {
+    cand = (irstreamcand_t *)&irparams.stream.cand[i];
+    if (!cand->proto) {
+      continue;
     }
-    offset++;
-    for (i = 0; i < JVC_BITS; i++) {
-        if (!MATCH_MARK(results->rawbuf[offset], JVC_BIT_MARK)) {
-            return ERR;
-        }
-        offset++;
-        if (MATCH_SPACE(results->rawbuf[offset], JVC_ONE_SPACE)) {
-            data = (data << 1) | 1;
-        } 
-        else if (MATCH_SPACE(results->rawbuf[offset], JVC_ZERO_SPACE)) {
-            data <<= 1;
-        } 
-        else {
-            return ERR;
+    switch (ir_streamStep(cand, ticks)) {
+      case STREAM_RUN:
+        alive++;
+        break;
+      case STREAM_DONE:
+        if (!alive) {
+          ir_streamPublish(cand);
+          return;
         }
-        offset++;
+        // a candidate before this one may still match a longer frame,
+        // the ones after it come too late
+        irparams.stream.done = i + 1;
+        irparams.stream.count = i;
+        break;
+      default:
+        cand->proto = 0;
+        break;
     }
-    //Stop bit
-    if (!MATCH_MARK(results->rawbuf[offset], JVC_BIT_MARK)){
-        return ERR;
+  }
+  if (!alive) {
+    irparams.stream.count = 0;
+  }
+  else if (irparams.stream.done) {
+    irparams.stream.wait = 0;
+    for (i = 0; i < irparams.stream.count; i++) {
+      cand = (irstreamcand_t *)&irparams.stream.cand[i];
+      if (cand->proto && ir_streamBound(cand) > irparams.stream.wait) {
+        irparams.stream.wait = ir_streamBound(cand);
+      }
     }
-    // Success
-    results->bits = JVC_BITS;
-    results->value = data;
-    results->decode_type = JVC;
-    return DECODED;
+  }
+}
+#endif
+
+#ifdef IR_EARLY_END
+/* -----------------------------------------------------------------------
+ * Early end of frame
+ * A frame normally ends with a space of more than GAP_TICKS. For the
+ * protocols below the header tells how many entries the frame has and
+ * how long its spaces can get, so ir_endEdge() ends the frame with its
+ * stop mark, or after a gap just longer than the longest space that can
+ * still follow. Sigma has a long space between its bytes, so its short
+ * gap only applies after it.
+ */
+static const irframeend_t ir_frameEnds[] = {
+  { TICKS_MARK(NEC_HDR_MARK), TICKS_SPACE(NEC_HDR_SPACE),
+    2 * NEC_BITS + 4, 3, GAP_TICKS, END_GAP(NEC_ONE_SPACE) },
+  { TICKS_MARK(NEC_HDR_MARK), TICKS_SPACE(NEC_RPT_SPACE),
+    4, 3, GAP_TICKS, GAP_TICKS },
+  // the space between the bytes is entry 20
+  { TICKS_MARK(SIGMA_HDR_MARK), TICKS_SPACE(SIGMA_HDR_SPACE),
+    2 * SIGMA_BITS + 6, 2 * 8 + 5, END_GAP(SIGMA_NEXT_SPACE), END_GAP(SIGMA_ONE_SPACE) },
+  { TICKS_MARK(PANASONIC_HDR_MARK), TICKS_MARK(PANASONIC_HDR_SPACE),
+    2 * PANASONIC_BITS + 4, 3, GAP_TICKS, END_GAP(PANASONIC_ONE_SPACE) },
+  { TICKS_MARK(JVC_HDR_MARK), TICKS_SPACE(JVC_HDR_SPACE),
+    2 * JVC_BITS + 4, 3, GAP_TICKS, END_GAP(JVC_ONE_SPACE) },
+};
+
+#define IR_FRAMEENDS (sizeof(ir_frameEnds) / sizeof(ir_frameEnds[0]))
+
+// Called by the ISR with each entry it records (rawbuf[rawlen - 1])
+static void ir_endEdge(unsigned int ticks)
+{
+  unsigned int index = irparams.rawlen - 1;
+  unsigned char i = 0;
+  unsigned char count = 0;
+  unsigned char from = 0;
+  unsigned int longGap = 0;
+  unsigned int gap = 0;
+  const irframeend_t *end;
+
+  if (index == 0) {
+    irparams.endcount = 0;
+    irparams.endfrom = 0;
+    irparams.endgap = GAP_TICKS;
+    return;
+  }
+  if (index == 1) {
+    irparams.endmark = ticks;
+    return;
+  }
+  if (index == 2) {
+    for (i = 0; i < IR_FRAMEENDS; i++) {
+      end = &ir_frameEnds[i];
+      if (!ir_match(irparams.endmark, end->markLow, end->markHigh) ||
+          !ir_match(ticks, end->spaceLow, end->spaceHigh)) {
+        continue;
+      }
+      if (end->count > count) {
+        count = end->count;
+      }
+      if (end->gapFrom > from) {
+        from = end->gapFrom;
+      }
+      if (end->longGap > longGap) {
+        longGap = end->longGap;
+      }
+      if (end->gap > gap) {
+        gap = end->gap;
+      }
+    }
+    if (!count) {
+      // unknown header, the frame ends with the gap
+      return;
+    }
+    irparams.endcount = count;
+    irparams.endfrom = from;
+    irparams.endgap = longGap;
+    irparams.endlate = gap;
+  }
+  if (irparams.rawlen == irparams.endfrom) {
+    irparams.endgap = irparams.endlate;
+  }
+  if (irparams.rawlen == irparams.endcount) {
+    irparams.endnow = IR_END_COUNT;
+  }
 }
+#endif
 
 /* -----------------------------------------------------------------------
  * hashdecode - decode an arbitrary IR code.
@@ -997,12 +2557,12 @@ static long ir_decodeJVC(decode_results *results) {
 
 // Compare two tick values, returning 0 if newval is shorter,
 // 1 if newval is equal, and 2 if newval is longer
-// Use a tolerance of 20%
+// Use a tolerance of 20% (x < y * .8 is 5x < 4y)
 static int ir_compare(unsigned int oldval, unsigned int newval) {
-  if (newval < oldval * .8) {
+  if ((unsigned long)newval * 5 < (unsigned long)oldval * 4) {
     return 0;
   } 
-  else if (oldval < newval * .8) {
+  else if ((unsigned long)oldval * 5 < (unsigned long)newval * 4) {
     return 2;
   } 
   else {
@@ -1028,9 +2588,9 @@ static long ir_decodeHash(decode_results *results)
   }
 
   for (i = 1; i+2 < results->rawlen; i++) {
-    int value =  ir_compare(results->rawbuf[i], results->rawbuf[i+2]);
-    // Add value into the hash
-    hash = (hash * FNV_PRIME_32) ^ value;
+    int value =  ir_compare(ir_rawAt(results, i), ir_rawAt(results, i+2));
+    // Add value into the hash, kept at 32 bits where long is wider
+    hash = ((hash * FNV_PRIME_32) ^ value) & 0xFFFFFFFFUL;
   }
   results->value = hash;
   results->bits = 32;
@@ -1063,7 +2623,7 @@ linked LIRC file.
 void ir_sendSharp(unsigned long data, int nbits) {
   unsigned long invertdata = data ^ SHARP_TOGGLE_MASK;
   int i = 0;
-  ir_enableIROut(38);
+  ir_txBegin(38);
   for (i = 0; i < nbits; i++) {
     if (data & 0x4000) {
       ir_mark(SHARP_BIT_MARK);
@@ -1078,7 +2638,7 @@ void ir_sendSharp(unsigned long data, int nbits) {
   
   ir_mark(SHARP_BIT_MARK);
   ir_space(SHARP_ZERO_SPACE);
-  ir_delay(46);
+  ir_pause(46);
   for (i = 0; i < nbits; i++) {
     if (invertdata & 0x4000) {
       ir_mark(SHARP_BIT_MARK);
@@ -1092,13 +2652,14 @@ void ir_sendSharp(unsigned long data, int nbits) {
   }
   ir_mark(SHARP_BIT_MARK);
   ir_space(SHARP_ZERO_SPACE);
-  ir_delay(46);
+  ir_pause(46);
+  ir_txEnd();
 }
 
 void ir_sendDISH(unsigned long data, int nbits)
 {
   int i = 0;
-  ir_enableIROut(56);
+  ir_txBegin(56);
   ir_mark(DISH_HDR_MARK);
   ir_space(DISH_HDR_SPACE);
   for (i = 0; i < nbits; i++) {
@@ -1112,20 +2673,12 @@ void ir_sendDISH(unsigned long data, int nbits)
     }
     data <<= 1;
   }
+  ir_txEnd();
 }
 
 
-static int MATCH(int measured, int desired)
-{
-    return measured >= TICKS_LOW(desired) && measured <= TICKS_HIGH(desired);
-}
-
-static int MATCH_MARK(int measured_ticks, int desired_us)
-{
-    return MATCH(measured_ticks, (desired_us + MARK_EXCESS));
-}
-
-static int MATCH_SPACE(int measured_ticks, int desired_us)
+static int ir_match(unsigned int measured, unsigned int low, unsigned int high)
 {
-    return MATCH(measured_ticks, (desired_us - MARK_EXCESS));
+    IR_COUNT_MATCH();
+    return measured >= low && measured <= high;
 }
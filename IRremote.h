@@ -16,7 +16,123 @@
 #ifndef IRremote_h
 #define IRremote_h
 
+#ifndef RAWBUF
 #define RAWBUF 100 // Length of raw duration buffer
+#endif
+#ifndef RAWFRAMES
+#define RAWFRAMES 2 // Number of frames the receiver can hold until ir_resume(), power of two
+#endif
+
+// Receive backends
+// IR_RX_POLL samples the detector every 50us from the Timer3 interrupt.
+// IR_RX_EDGE timestamps the detector edges (RB port change interrupt) against
+// a free running Timer3, so there is only one interrupt per edge.
+#define IR_RX_POLL 0
+#define IR_RX_EDGE 1
+#ifndef IR_RX_BACKEND
+#define IR_RX_BACKEND IR_RX_POLL
+#endif
+
+// Define IR_HOST to build the library on a PC instead of the PIC. The
+// timers run on a virtual clock, see IRremoteHost.h: ir_hostRun() lets it
+// run, ir_hostSetInput() drives the detector output and ir_hostSetOutput()
+// reports the carrier, ir_hostCarrierHz() and ir_hostCarrierDuty() give the
+// Timer2 setup of it. ir_hostMatches() counts the ir_match() calls of each
+// decoder, host/bench.c uses them to profile ir_decode().
+// ir_hostInterrupts() counts the interrupts, host/timing.c compares the
+// receive backends with it.
+// host/noise.c sends every protocol through a model of the detector with
+// lag, jitter, dropped and extra pulses and clock drift. To tune against it
+// MARK_EXCESS and TOLERANCE (IRremoteInt.h) can be defined on the command
+// line.
+
+// Raw buffer entries
+// With IR_RAWBUF_COMPACT defined every duration takes one byte instead of
+// two. Durations from RAW_ESC ticks on are kept in a table of RAWLONG
+// entries per frame and the byte refers to it. Read entries with ir_rawAt().
+#ifndef RAWLONG
+#define RAWLONG 8 // Long durations per frame
+#endif
+#define RAW_ESC (256 - RAWLONG)
+#ifdef IR_RAWBUF_COMPACT
+typedef unsigned char rawbuf_t;
+#else
+typedef unsigned int rawbuf_t;
+#endif
+
+// Define IR_STREAM_DECODE to decode NEC, Sigma, Panasonic and JVC frames
+// edge by edge in the receive interrupt. Such a frame is handed over at its
+// stop mark instead of after the 5ms gap, and ir_decode() only copies the
+// result, see ir_streamEdge() (costs about 50 + 10 * RAWFRAMES bytes of RAM).
+// JVC shares its header with NEC and is handed over once the space after
+// its stop mark is too long for a NEC bit, about 2ms.
+
+// Define IR_EARLY_END to end frames by the rule of their header instead of
+// the 5ms gap only: at the expected number of entries or after a gap just
+// longer than the longest space of the protocol, see ir_frameEnds[].
+// Frames of other remotes with the same header are cut the same way.
+
+// Carrier duty cycle in percent, see ir_setCarrierDuty(). Less than 50
+// drives the LED harder for the same average current.
+#ifndef IR_DUTY
+#define IR_DUTY 50
+#endif
+
+// Number of IR emitters. With more than one the carrier pin drives the LED
+// drivers of all of them and IR_CHANNEL_PINS lists an enable pin per
+// channel (pin numbers of ir_pinMode()), only the one of the channel that
+// sends is high. ir_setChannel() selects the channel of the next ir_send*
+// calls. With IR_TX_ASYNC the next queued frame is sent in the gap of a
+// running sequence or hold if it is for another channel and fits in.
+#ifndef IR_CHANNELS
+#define IR_CHANNELS 1
+#endif
+#if IR_CHANNELS > 1 && !defined(IR_CHANNEL_PINS)
+#if IR_CHANNELS == 2
+#define IR_CHANNEL_PINS { 21, 22 } // RB0 and RB1
+#elif IR_CHANNELS == 3
+#define IR_CHANNEL_PINS { 21, 22, 23 } // RB0 to RB2
+#else
+#define IR_CHANNEL_PINS { 21, 22, 23, 24 } // RB0 to RB3, more have to be listed
+#endif
+#endif
+
+// Define IR_TX_ASYNC to send from the Timer1 interrupt: the ir_send*
+// functions queue the frame and return, ir_txWait() waits until it is sent.
+// ir_sendSequence() sends a list of codes with gaps as one such job,
+// ir_holdStart() repeats a code like a held key until ir_holdStop().
+// The queue does not run empty while a key is held: ir_txWait() returns 0
+// at once, and the ir_send* functions return 0 instead of waiting once all
+// slots are in use.
+// ir_delay() uses Timer1 as well, so it waits for the queue first, and
+// returns 0 without waiting while a key is held.
+// A frame with more than IR_TXBUF marks and spaces is not sent at all,
+// ir_sendCode() then returns 0, see ir_txGetOverruns().
+#ifndef IR_TXQUEUE
+#define IR_TXQUEUE 2 // Number of frames that can be queued, power of two
+#endif
+#ifndef IR_TXBUF
+#define IR_TXBUF 100 // Marks and spaces per queued or cached frame
+#endif
+
+// Define IR_TX_LISTEN to keep receiving while sending (polling receiver
+// only). The detector output is ignored while our carrier is on and for
+// IR_TX_GUARD afterwards, so only foreign marks are recorded. A foreign
+// mark while sending counts as collision, see ir_getCollisions().
+// Foreign marks that overlap our own marks are lost.
+#ifndef IR_TX_GUARD
+#define IR_TX_GUARD 300 // microseconds our echo may last after our mark
+#endif
+
+// Define IR_STATS to count interrupt load, lost frames, decode results and
+// sending, see ir_getStats(). The interrupt is timed with Timer0, which
+// then runs free at the instruction clock (costs about 50 bytes of RAM and
+// 30 cycles per interrupt).
+
+// Define IR_WAVECACHE as a number of entries to keep the waveforms of the
+// last codes sent by ir_sendCached(). A code is encoded into Timer1 reload
+// values once, repeats of it only replay them (costs about
+// 2.2 * IR_TXBUF + 12 bytes of RAM per entry)
 
 // Results returned from the decoder
 typedef struct {
@@ -24,10 +140,21 @@ typedef struct {
   unsigned int panasonicAddress; // This is only used for decoding Panasonic data
   unsigned long value; // Decoded value
   int bits; // Number of bits in decoded value
-  volatile unsigned int *rawbuf; // Raw intervals in .5 us ticks
+  rawbuf_t *rawbuf; // Raw intervals in 50 us ticks, valid until ir_resume()
+#ifdef IR_RAWBUF_COMPACT
+  unsigned int *rawlong; // Long intervals referred to by rawbuf
+#endif
   int rawlen; // Number of records in rawbuf.
+  unsigned char endReason; // How the receiver ended the frame, IR_END_*
 } decode_results;
 
+// Reads entry index of rawbuf in 50 us ticks
+#ifdef IR_RAWBUF_COMPACT
+extern unsigned int ir_rawAt(decode_results *results, int index);
+#else
+#define ir_rawAt(results, index) ((results)->rawbuf[index])
+#endif
+
 // Values for decode_type
 #define NEC 1
 #define SONY 2
@@ -55,6 +182,61 @@ typedef struct {
 #define PANASONIC_BITS_VAL 32
 #define JVC_BITS 16
 
+// A code to send, see ir_sendCode()
+typedef struct {
+  int decode_type; // NEC, SONY, RC5, ...
+  unsigned long value; // Value to send, REPEAT sends the NEC repeat frame
+  int bits; // Number of bits of value
+  unsigned int address; // Only used for Panasonic
+} ir_code_t;
+
+// An entry of a sequence, see ir_sendSequence()
+typedef struct {
+  ir_code_t code; // Code to send
+  unsigned char times; // Number of sends, 0 is the same as 1
+  unsigned int gap; // Pause after each send in ms
+} ir_seqentry_t;
+
+// Values for endReason
+#define IR_END_GAP 1    // space longer than the gap
+#define IR_END_FULL 2   // rawbuf full
+#define IR_END_COUNT 3  // all entries the header announces were received
+#define IR_END_STREAM 4 // stop mark decoded in the ISR
+
+#ifdef IR_STATS
+// Counters since ir_resetStats(), see ir_getStats()
+typedef struct {
+  unsigned long isrCalls;         // ir_interruptService() calls
+  unsigned int isrMaxTicks;       // longest call in Timer0 ticks (instruction cycles)
+  unsigned int rawFull;           // frames cut because rawbuf was full
+  unsigned int framesLost;        // frames lost while all RAWFRAMES slots were in use
+  unsigned int decoded[SIGMA + 1]; // frames per decode_type, UNKNOWN (the hash) in 0
+  unsigned int failed;            // frames too short even for the hash
+  unsigned int txFrames;          // frames sent
+  unsigned long txBusyUs;         // time the carrier was switched for them
+} ir_stats_t;
+#endif
+
+// Compact raw codes for ir_sendRawCompact(), e.g. in program memory, use
+// the entries of the compact raw buffer: one byte per mark or space in
+// receiver ticks of IR_RAW_UNIT microseconds, and RAW_ESC + k for entry k
+// of a table of longer durations, also in ticks. A received frame in the
+// compact raw buffer has the same layout from rawbuf[1] on. Durations are
+// limited to 65535us.
+// const unsigned char code[] = { IR_RAW(9000), IR_RAW(4500), IR_RAW(560), ..., IR_RAW_LONG(0) };
+// const unsigned int longs[] = { IR_RAW(40000) };
+#define IR_RAW_UNIT 50 // USECPERTICK
+#define IR_RAW(us) (((us) + IR_RAW_UNIT / 2) / IR_RAW_UNIT)
+#define IR_RAW_LONG(index) (RAW_ESC + (index))
+
+// Packed raw codes of ir_packCapture() and ir_sendPacked(): the number n
+// of durations, the number of marks and spaces, n durations in
+// microseconds (high byte first), then one index into the durations per
+// mark or space, 2 bits each if n <= 4 or else 3 bits, packed from the
+// least significant bit on.
+#define IR_PACKED_MAX 8
+#define IR_PACKED_SIZE(entries) (2 + 2 * IR_PACKED_MAX + ((entries) * 3 + 7) / 8) // enough for any code
+
 // Decoded value for NEC when a repeat code is received
 #define REPEAT 0xffffffff
 
@@ -70,17 +252,63 @@ extern void ir_blink13(int blinkflag);
 extern int ir_decode(decode_results *results);
 extern void ir_enableIRIn(void);
 extern void ir_resume(void);
+extern unsigned int ir_getOverflowCount(void);
+extern unsigned char ir_getFramesPeak(void);
+extern void ir_resetOverflowCount(void);
 extern void ir_sendNECRepeatFrame(void);
 extern void ir_sendNEC(unsigned long data, int nbits);
-extern void ir_sendSigma(unsigned long data, int nbits);
+extern void ir_sendSigma(unsigned long data, int nbits); // *Note sends nothing unless nbits is SIGMA_BITS (16), the long space follows the first byte. ir_sendCode() returns 0 for other lengths.
 extern void ir_sendSony(unsigned long data, int nbits);
-extern void ir_sendRaw(unsigned int buf[], int len, int hz);
+extern void ir_sendRaw(const unsigned int buf[], int len, int hz);
+extern void ir_sendRawCompact(const unsigned char buf[], int len, const unsigned int longs[], int hz);
+extern void ir_sendCapture(decode_results *results, int hz);
+extern int ir_packCapture(decode_results *results, unsigned char code[], int size);
+extern void ir_sendPacked(const unsigned char code[], int hz);
 extern void ir_sendRC5(unsigned long data, int nbits);
 extern void ir_sendRC6(unsigned long data, int nbits);
 extern void ir_sendDISH(unsigned long data, int nbits);
 extern void ir_sendSharp(unsigned long data, int nbits);
 extern void ir_sendPanasonic(unsigned int address, unsigned long data);
 extern void ir_sendJVC(unsigned long data, int nbits, int repeat); // *Note instead of sending the REPEAT constant if you want the JVC repeat signal sent, send the original code value and change the repeat argument from 0 to 1. JVC protocol repeats by skipping the header NOT by sending a separate code value like NEC does.
-extern void ir_delay(unsigned long time);
+extern int ir_sendCode(const ir_code_t *code);
+extern void ir_setCarrierDuty(unsigned char percent);
+#if IR_CHANNELS > 1
+extern void ir_setChannel(unsigned char channel);
+#endif
+extern unsigned char ir_delay(unsigned long time);
+#ifdef IR_TX_ASYNC
+extern unsigned char ir_txPending(void);
+extern unsigned char ir_txWait(void);
+extern void ir_txSetCallback(void (*callback)(void));
+extern unsigned int ir_txGetOverruns(void);
+extern int ir_sendSequence(const ir_seqentry_t *entries, unsigned char count, void (*done)(void));
+extern unsigned char ir_seqBusy(void);
+extern int ir_holdStart(const ir_code_t *code);
+extern void ir_holdStop(void);
+#endif
+#ifdef IR_TX_LISTEN
+extern unsigned int ir_getCollisions(void);
+#endif
+#ifdef IR_STATS
+extern void ir_getStats(ir_stats_t *stats);
+extern void ir_resetStats(void);
+#endif
+#ifdef IR_WAVECACHE
+extern int ir_sendCached(const ir_code_t *code);
+extern void ir_clearCache(void);
+#endif
+#ifdef IR_HOST
+#define IR_HOST_MARK 0  // detector output during a mark, see ir_hostSetInput()
+#define IR_HOST_SPACE 1
+extern void ir_hostRun(unsigned long us);
+extern unsigned long ir_hostMicros(void);
+extern void ir_hostSetInput(unsigned char level);
+extern void ir_hostSetOutput(void (*output)(unsigned char on, unsigned char khz));
+extern unsigned long ir_hostMatches(int decode_type);
+extern void ir_hostClearMatches(void);
+extern unsigned long ir_hostInterrupts(void);
+extern unsigned long ir_hostCarrierHz(void);
+extern unsigned int ir_hostCarrierDuty(void);
+#endif
 
 #endif
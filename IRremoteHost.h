@@ -0,0 +1,418 @@
+/*
+ * IRremote
+ * Version 0.1 July, 2009
+ * Copyright 2009 Ken Shirriff
+ * For details, see http://arcfn.com/2009/08/multi-protocol-infrared-remote-library.html
+ *
+ * Modified by Paul Stoffregen <paul@pjrc.com> to support other boards and timers
+ * Ported to PIC18F2550 by Marco Koehler, 2013
+ *
+ * Interrupt code based on NECIRrcv by Joe Knapp
+ * http://www.arduino.cc/cgi-bin/yabb2/YaBB.pl?num=1210243556
+ * Also influenced by http://zovirl.com/2008/11/12/building-a-universal-remote-with-an-arduino/
+ *
+ * JVC and Panasonic protocol added by Kristian Lauszus (Thanks to zenwheel and other people at the original blog post)
+ */
+
+#ifndef IRremoteHost_h
+#define IRremoteHost_h
+
+// Linux simulation backend of the hardware abstraction in IRremoteInt.h
+// A virtual clock replaces the PIC timers. It runs at SYSCLOCK and only
+// moves inside ir_hostRun() and the busy loops of the library (IR_WAIT),
+// where it stops at every timer event and runs ir_interruptService() for
+// the flags that are enabled, like the PIC would. The library code itself
+// takes no virtual time.
+
+#define HOST_NEVER           0xFFFFFFFFFFFFFFFFULL
+#define HOST_CYCLES_PER_US   (SYSCLOCK/US_PER_SEC)
+// Timer3 of the edge receiver counts as wide as unsigned int. The library
+// only takes differences of its values, so it wraps the same way it does
+// at 16 bits on the PIC.
+#define HOST_EDGE_WRAP       (1ULL << (8 * sizeof(unsigned int)))
+#define HOST_DECODERS        (SIGMA + 2) // decode_type + 1, UNKNOWN is 0
+
+// state of the simulated PIC
+typedef struct {
+  unsigned long long now;      // virtual time in instruction cycles
+  unsigned char gie;           // interrupts enabled
+  unsigned char inisr;         // ir_interruptService() is running
+  unsigned char inmark;        // detector output is MARK, else SPACE
+  unsigned char carrier;       // carrier is on
+  unsigned int t2steps;        // PR2 + 1, Timer2 counts per carrier period
+  unsigned char t2prescale;    // Timer2 prescale, 1, 4 or 16
+  unsigned char ccpr1l;        // Timer2 counts per carrier period the pin is high
+  unsigned char pins[32];      // levels written by ir_digitalWrite()
+  void (*output)(unsigned char on, unsigned char khz); // told about carrier changes
+  unsigned char t1on, t1ie, t1if; // Timer1, times the marks and spaces
+  unsigned long long t1ovf;    // time Timer1 rolls over next
+  unsigned char t3on, t3ie, t3if; // Timer3, sample clock or edge time base
+  unsigned long long t3ovf;    // time Timer3 rolls over next (polling receiver)
+  unsigned long long t3zero;   // time Timer3 was 0 (edge receiver)
+  unsigned char rbie, rbif;    // port change interrupt of the receive pin
+  unsigned char ccp2ie, ccp2if; // CCP2 compare against Timer3
+  unsigned long long ccp2at;   // time of the next compare match
+  unsigned char decoder;       // decode_type + 1 of the decoder that runs
+  unsigned long interrupts;    // ir_interruptService() calls
+  unsigned long matches[HOST_DECODERS]; // ir_match() calls per decoder
+} irhost_t;
+
+static irhost_t ir_host = { 0 };
+
+static void ir_hostCarrier(unsigned char on);
+static void ir_hostWait(void);
+
+////////////////////////////////////////////////////////////
+// host hardware depending defines                        //
+////////////////////////////////////////////////////////////
+
+// the virtual clock runs at the speed of the PIC, so all tick math is the same
+#define SYSCLOCK 12000000
+
+// defines for timers
+#define CARRIER_ON           ir_hostCarrier(1)
+#define CARRIER_OFF          ir_hostCarrier(0)
+#if IR_RX_BACKEND == IR_RX_EDGE
+#define TIMER_ENABLE_INTR    (ir_host.rbie=1)
+#define TIMER_DISABLE_INTR   (ir_host.rbie=0)
+#else
+#define TIMER_ENABLE_INTR    (ir_host.t3ie=1)
+#define TIMER_DISABLE_INTR   (ir_host.t3ie=0)
+#endif
+#define TIMER_INT_FLAG       ir_host.t3if
+#define TIMER_INT_PENDING    (ir_host.t3ie && ir_host.t3if)
+#define TIMER_PWM_PIN        13
+#define DELAY_INT_FLAG       ir_host.t1if
+#define DELAY_RUNNING        ir_host.t1on
+#define DELAY_PRESCALE       4
+// ir_delayAdd() reads TMR1 HOST_T1_READ_CYCLES after it is called and
+// writes it HOST_T1_WRITE_CYCLES after the read, as the PIC code does. The
+// ticks in between are lost, and so is the part of a tick the prescaler
+// had counted at the read, since the write clears it. DELAY_ADD_TICKS
+// makes up for them with the value of the PIC.
+#ifndef HOST_T1_READ_CYCLES
+#define HOST_T1_READ_CYCLES  0
+#endif
+#ifndef HOST_T1_WRITE_CYCLES
+#define HOST_T1_WRITE_CYCLES 8
+#endif
+#ifndef DELAY_ADD_TICKS
+#define DELAY_ADD_TICKS      2
+#endif
+#define TX_INT_PENDING       (ir_host.t1ie && ir_host.t1if)
+
+// defines for blinking the LED
+#define BLINKLED_PIN         2
+#define BLINKLED_ON()        (ir_host.pins[BLINKLED_PIN] = 1)
+#define BLINKLED_OFF()       (ir_host.pins[BLINKLED_PIN] = 0)
+
+#define IR_RECEIVE_PIN       25
+
+// defines for the edge receive backend
+#define EDGE_PRESCALE        8
+#define EDGE_INT_FLAG        ir_host.rbif
+#define EDGE_INT_PENDING     (ir_host.rbie && ir_host.rbif)
+#define EDGE_TIMEOUT_FLAG    ir_host.ccp2if
+#define EDGE_TIMEOUT_PENDING (ir_host.ccp2ie && ir_host.ccp2if)
+#define EDGE_TIMEOUT_DISABLE (ir_host.ccp2ie=0)
+
+#define DISABLE_INTERRUPTS   (ir_host.gie = 0)
+#define ENABLE_INTERRUPTS    (ir_host.gie = 1)
+
+// the interrupts run on the thread of the library
+#define IR_BARRIER()
+// busy loops let the virtual clock run until an interrupt has done the work
+#define IR_WAIT()            ir_hostWait()
+// ir_match() calls are counted for the decoder that makes them
+#define IR_COUNT_DECODER(type) (ir_host.decoder = (unsigned char)((type) + 1))
+#define IR_COUNT_MATCH()     (ir_host.matches[ir_host.decoder]++)
+
+////////////////////////////////////////////////////////////
+// host hardware depending functions                      //
+////////////////////////////////////////////////////////////
+
+// Runs the interrupt service as long as an enabled interrupt flag is set
+static void ir_hostDispatch(void) {
+  if (ir_host.inisr) {
+    return;
+  }
+  ir_host.inisr = 1;
+  while (ir_host.gie && (TX_INT_PENDING || TIMER_INT_PENDING ||
+                         EDGE_INT_PENDING || EDGE_TIMEOUT_PENDING)) {
+    ir_host.interrupts++;
+    ir_interruptService();
+  }
+  ir_host.inisr = 0;
+}
+
+// Time of the next timer event, HOST_NEVER if no timer runs
+static unsigned long long ir_hostNext(void) {
+  unsigned long long next = HOST_NEVER;
+  if (ir_host.t1on && ir_host.t1ovf < next) {
+    next = ir_host.t1ovf;
+  }
+#if IR_RX_BACKEND == IR_RX_EDGE
+  if (ir_host.t3on && ir_host.ccp2at < next) {
+    next = ir_host.ccp2at;
+  }
+#else
+  if (ir_host.t3on && ir_host.t3ovf < next) {
+    next = ir_host.t3ovf;
+  }
+#endif
+  return next;
+}
+
+// Lets the virtual clock run to the time, the timers raise their flags on
+// the way and the interrupt service runs for them
+static void ir_hostAdvance(unsigned long long until) {
+  unsigned long long next;
+  ir_hostDispatch();
+  while ((next = ir_hostNext()) <= until) {
+    ir_host.now = next;
+    if (ir_host.t1on && ir_host.t1ovf == next) {
+      ir_host.t1if = 1;
+      ir_host.t1ovf += 65536ULL * DELAY_PRESCALE;
+    }
+#if IR_RX_BACKEND == IR_RX_EDGE
+    if (ir_host.t3on && ir_host.ccp2at == next) {
+      ir_host.ccp2if = 1;
+      ir_host.ccp2at += HOST_EDGE_WRAP * EDGE_PRESCALE;
+    }
+#else
+    if (ir_host.t3on && ir_host.t3ovf == next) {
+      ir_host.t3if = 1;
+      ir_host.t3ovf += 65536ULL;
+    }
+#endif
+    ir_hostDispatch();
+  }
+  if (until > ir_host.now) {
+    ir_host.now = until;
+  }
+}
+
+static void ir_hostWait(void) {
+  unsigned long long next = ir_hostNext();
+  if (next == HOST_NEVER) {
+    // nothing would end the loop on the PIC either
+    next = ir_host.now + HOST_CYCLES_PER_US;
+  }
+  ir_hostAdvance(next);
+}
+
+static void ir_hostCarrier(unsigned char on) {
+  if (on != ir_host.carrier) {
+    ir_host.carrier = on;
+    if (ir_host.output) {
+      ir_host.output(on, carrier_khz);
+    }
+  }
+}
+
+// Count of Timer1 at a time up to its next overflow
+static unsigned int ir_hostTmr1(unsigned long long at) {
+  return (unsigned int)(65536ULL - (ir_host.t1ovf - at + DELAY_PRESCALE - 1) / DELAY_PRESCALE);
+}
+
+#if IR_RX_BACKEND != IR_RX_EDGE
+static void ir_timerRst(void) {
+    /*next sample of the receiver*/
+    ir_host.t3ovf = ir_host.now + USECPERTICK * HOST_CYCLES_PER_US;
+}
+
+static void ir_timerCfgNorm(void) {
+  ir_host.t3if = 0;
+  ir_host.t3on = 1;
+  ir_timerRst();
+}
+#endif
+
+#if IR_RX_BACKEND == IR_RX_EDGE
+static void ir_timerCfgEdge(void) {
+  /*timer 3 free running for edge time stamps, CCP2 compares against it*/
+  ir_host.t3zero = ir_host.now;
+  ir_host.ccp2at = ir_host.now + HOST_EDGE_WRAP * EDGE_PRESCALE;
+  ir_host.ccp2if = 0;
+  ir_host.rbif = 0;
+  ir_host.t3on = 1;
+}
+
+static unsigned int ir_edgeTimerRead(void) {
+  return (unsigned int)((ir_host.now - ir_host.t3zero) / EDGE_PRESCALE);
+}
+
+static void ir_edgeArm(unsigned int ticks) {
+  unsigned int cmp = irparams.lastedge + ticks * EDGE_TMR_PER_TICK;
+  unsigned long long count = (ir_host.now - ir_host.t3zero) / EDGE_PRESCALE;
+  unsigned int ahead = cmp - (unsigned int)count; /*counts to the match*/
+  irparams.armticks = ticks;
+  ir_host.ccp2at = ir_host.t3zero + (count + (ahead ? ahead : HOST_EDGE_WRAP)) * EDGE_PRESCALE;
+  ir_host.ccp2if = 0;
+  ir_host.ccp2ie = 1;
+}
+#endif
+
+#ifdef IR_STATS
+static void ir_statsTimerCfg(void) {
+}
+
+// the interrupt takes no virtual time, so it always measures 0 here
+static unsigned int ir_statsTimerRead(void) {
+  return (unsigned int)ir_host.now;
+}
+#endif
+
+#ifdef IR_TX_ASYNC
+static void ir_txTimerCfg(void) {
+  /*timer 1 interrupt at the end of each mark or space during ir-sending*/
+  ir_delayStart();
+  ir_host.t1ie = 1;
+}
+
+static void ir_txTimerStop(void) {
+  ir_delayStop();
+  ir_host.t1ie = 0;
+  DELAY_INT_FLAG = 0;
+}
+#endif
+
+static void ir_timerCfgKhz(unsigned char val) {
+  /*Timer2 and CCP1 get the setup of the PIC, see ir_hostCarrierHz()*/
+  ircarrier_t cfg;
+  if (val == carrier_khz) {
+    return; // already set up
+  }
+  ir_carrierCfg(&cfg, val);
+  ir_host.t2steps = cfg.steps;
+  ir_host.t2prescale = (unsigned char)(1 << (2 * cfg.ckps));
+  ir_host.ccpr1l = cfg.duty;
+  carrier_khz = val;
+}
+
+static void ir_digitalWrite(unsigned int pin, unsigned value)
+{
+    if (pin < sizeof(ir_host.pins)) {
+        ir_host.pins[pin] = (unsigned char)value;
+    }
+}
+
+static unsigned ir_digitalRead(unsigned int pin)
+{
+    if (pin == IR_RECEIVE_PIN) {
+        return ir_host.inmark ? MARK : SPACE;
+    }
+    return pin < sizeof(ir_host.pins) ? ir_host.pins[pin] : 0;
+}
+
+static void ir_pinMode(unsigned int pin, unsigned mode)
+{
+    /*the host pins need no setup*/
+    (void)pin;
+    (void)mode;
+}
+
+static void ir_delayStart(void)
+{
+    /*timer 1 runs through the frame, ir_delayAdd() chains the periods*/
+    ir_host.t1ovf = ir_host.now + 65536ULL * DELAY_PRESCALE;
+    DELAY_INT_FLAG = 0;
+    ir_host.gie = 1;
+    ir_host.t1on = 1;
+}
+
+static void ir_delayAdd(unsigned int reload)
+{
+    /*the ticks since the last overflow are kept, so delays do not add up*/
+    unsigned long long read = ir_host.now + HOST_T1_READ_CYCLES;
+    /*Timer1 has 16 bits, unsigned int may have more here*/
+    unsigned int tm_val = (ir_hostTmr1(read) + reload + DELAY_ADD_TICKS) & 0xFFFF;
+    /*the write starts Timer1 with an empty prescaler*/
+    ir_host.t1ovf = read + HOST_T1_WRITE_CYCLES + (65536UL - tm_val) * DELAY_PRESCALE;
+    DELAY_INT_FLAG = 0;
+}
+
+static void ir_delayStop(void)
+{
+    ir_host.t1on = 0;
+}
+
+static void ir_delayReload(unsigned int reload)
+{
+    if (!DELAY_RUNNING) {
+        ir_delayStart();
+    }
+    ir_delayAdd(reload);
+    while(DELAY_INT_FLAG == 0){
+        ir_hostWait();
+    }
+}
+
+////////////////////////////////////////////////////////////
+// host interface                                         //
+////////////////////////////////////////////////////////////
+
+// Lets the virtual clock run for the microseconds
+void ir_hostRun(unsigned long us) {
+  ir_hostAdvance(ir_host.now + (unsigned long long)us * HOST_CYCLES_PER_US);
+}
+
+// Virtual time in microseconds
+unsigned long ir_hostMicros(void) {
+  return (unsigned long)(ir_host.now / HOST_CYCLES_PER_US);
+}
+
+// Sets the detector output, MARK or SPACE, at the current virtual time
+void ir_hostSetInput(unsigned char level) {
+  if ((level == MARK) == ir_host.inmark) {
+    return;
+  }
+  ir_host.inmark = level == MARK;
+  ir_host.rbif = 1;
+  ir_hostDispatch();
+}
+
+// ir_match() calls of the decoder of the decode_type since the last
+// ir_hostClearMatches(), UNKNOWN counts the ones outside of the decoders
+unsigned long ir_hostMatches(int decode_type) {
+  if (decode_type < UNKNOWN || decode_type + 1 >= HOST_DECODERS) {
+    return 0;
+  }
+  return ir_host.matches[decode_type + 1];
+}
+
+void ir_hostClearMatches(void) {
+  unsigned char i;
+  for (i = 0; i < HOST_DECODERS; i++) {
+    ir_host.matches[i] = 0;
+  }
+}
+
+// Number of ir_interruptService() calls so far
+unsigned long ir_hostInterrupts(void) {
+  return ir_host.interrupts;
+}
+
+// Frequency of the carrier in Hz and its duty cycle in 1/10 percent, as
+// Timer2 and CCP1 generate them for the last frame, 0 before the first one
+unsigned long ir_hostCarrierHz(void) {
+  if (!ir_host.t2steps) {
+    return 0;
+  }
+  return SYSCLOCK / ((unsigned long)ir_host.t2prescale * ir_host.t2steps);
+}
+
+unsigned int ir_hostCarrierDuty(void) {
+  if (!ir_host.t2steps) {
+    return 0;
+  }
+  return (unsigned int)((ir_host.ccpr1l * 1000UL + ir_host.t2steps / 2) / ir_host.t2steps);
+}
+
+// Sets the function told about each carrier change, with the carrier
+// frequency in kHz. It may call ir_hostSetInput() to loop the sender back.
+void ir_hostSetOutput(void (*output)(unsigned char on, unsigned char khz)) {
+  ir_host.output = output;
+}
+
+#endif
@@ -17,8 +17,6 @@
 #ifndef IRremoteint_h
 #define IRremoteint_h
 
-#include "p18f2550.h"
-
 #include "IRremote.h"
 
 
@@ -27,7 +25,9 @@
 
 // Marks tend to be 100us too long, and spaces 100us too short
 // when received due to sensor lag.
+#ifndef MARK_EXCESS
 #define MARK_EXCESS 100
+#endif
 
 // Pulse parms are *50-100 for the Mark and *50+100 for the space
 // First MARK is the one after the long gap
@@ -38,6 +38,7 @@
 #define NEC_ONE_SPACE 1600
 #define NEC_ZERO_SPACE  560
 #define NEC_RPT_SPACE 2250
+#define NEC_RPT_LENGTH 110000
 
 #define SIGMA_HDR_MARK  8440
 #define SIGMA_HDR_SPACE 4240
@@ -111,15 +112,169 @@
 #define SHARP_BITS 15
 #define DISH_BITS 16
 
+#ifndef TOLERANCE
 #define TOLERANCE 25  // percent tolerance in measurements
-#define LTOL (1.0 - TOLERANCE/100.) 
-#define UTOL (1.0 + TOLERANCE/100.) 
+#endif
 
 #define _GAP 5000 // Minimum map between transmissions
 #define GAP_TICKS (_GAP/USECPERTICK)
 
-#define TICKS_LOW(us) (int) (((us)*LTOL/USECPERTICK))
-#define TICKS_HIGH(us) (int) (((us)*UTOL/USECPERTICK + 1))
+// Tick bounds for a duration in microseconds. Integer only, so with a
+// constant duration the compiler folds them and matching is a plain compare.
+#define TICKS_LOW(us) ((unsigned int)(((us) * (100L - TOLERANCE)) / (100L * USECPERTICK)))
+#define TICKS_HIGH(us) ((unsigned int)(((us) * (100L + TOLERANCE)) / (100L * USECPERTICK) + 1))
+
+#define MATCH(measured, desired_us) ir_match((measured), TICKS_LOW(desired_us), TICKS_HIGH(desired_us))
+#define MATCH_MARK(measured_ticks, desired_us) MATCH((measured_ticks), (desired_us) + MARK_EXCESS)
+#define MATCH_SPACE(measured_ticks, desired_us) MATCH((measured_ticks), (desired_us) - MARK_EXCESS)
+
+// Tick bounds of 1, 2 and 3 times t1 for ir_getRClevel()
+// indexed by [MARK or SPACE][multiple - 1]
+typedef struct {
+  unsigned int low[2][3];
+  unsigned int high[2][3];
+} rclevel_t;
+
+#define RC_LEVEL_BOUNDS(t1) { \
+  { { TICKS_LOW(t1 + MARK_EXCESS), TICKS_LOW(2*t1 + MARK_EXCESS), TICKS_LOW(3*t1 + MARK_EXCESS) }, \
+    { TICKS_LOW(t1 - MARK_EXCESS), TICKS_LOW(2*t1 - MARK_EXCESS), TICKS_LOW(3*t1 - MARK_EXCESS) } }, \
+  { { TICKS_HIGH(t1 + MARK_EXCESS), TICKS_HIGH(2*t1 + MARK_EXCESS), TICKS_HIGH(3*t1 + MARK_EXCESS) }, \
+    { TICKS_HIGH(t1 - MARK_EXCESS), TICKS_HIGH(2*t1 - MARK_EXCESS), TICKS_HIGH(3*t1 - MARK_EXCESS) } } }
+
+// Tick bounds of a mark or space, as initializer of an irrange_t
+#define TICKS_MARK(us)  TICKS_LOW((us) + MARK_EXCESS), TICKS_HIGH((us) + MARK_EXCESS)
+#define TICKS_SPACE(us) TICKS_LOW((us) - MARK_EXCESS), TICKS_HIGH((us) - MARK_EXCESS)
+#define TICKS_ANY       0, 0xFFFF
+
+typedef struct {
+  unsigned int low, high;
+} irrange_t;
+
+// Descriptor of a pulse distance / pulse width protocol for ir_decodePulse()
+typedef struct {
+  int type;                    // decode_type of a frame
+  unsigned char flags;         // PULSE_*
+  unsigned char hdrLen;        // header entries after the gap
+  irrange_t hdr[3];
+  irrange_t fixed;             // constant half of a bit
+  irrange_t one;               // other half of a one bit
+  irrange_t zero;              // other half of a zero bit
+  unsigned char nbits;         // bits of a frame, minimum with PULSE_VARLEN
+  unsigned char addrBits;      // after this many bits the data is the panasonicAddress
+  unsigned char sepAfter;      // index of the bit followed by sepMark, sepSpace
+  irrange_t sepMark, sepSpace;
+  unsigned char minLen;        // minimum rawlen
+  unsigned char resultBits;    // bits reported for a fixed length frame
+  unsigned char rptKind;       // PULSE_RPT_*
+  unsigned char rptLen;        // rawlen of a repeat frame
+  irrange_t rptSpace;          // header space of a PULSE_RPT_SHORT frame
+  unsigned int rptGap;         // gap in ticks below which a frame is a PULSE_RPT_GAP repeat
+  int rptType;                 // decode_type of a repeat
+} irpulse_t;
+
+#define PULSE_VARLEN     0x01  // bits until the fixed half does not match
+#define PULSE_DATA_FIRST 0x02  // data half comes before the fixed half
+#define PULSE_STOP       0x04  // frame ends with a fixed half
+#define PULSE_NOSEP      0xFF
+
+#define PULSE_RPT_NONE   0
+#define PULSE_RPT_SHORT  1     // header mark, rptSpace, fixed half
+#define PULSE_RPT_NOHDR  2     // frame without header
+#define PULSE_RPT_GAP    3     // frame after a short gap
+
+// Header signature of a decoder for the dispatch in ir_decode()
+// A decoder is only tried if rawlen is in range and the first mark and
+// space (rawbuf[1], rawbuf[2]) match, or if the gap before the frame
+// (rawbuf[0]) is below gapBelow, which is how Sony and Sanyo spot repeats.
+// Either decode or pulse (for ir_decodePulse()) is set.
+typedef struct {
+  int type;                    // decode_type the decoder finds
+  long (*decode)(decode_results *results);
+  const irpulse_t *pulse;
+  unsigned int markLow, markHigh;
+  unsigned int spaceLow, spaceHigh;
+  unsigned int minLen, maxLen;
+  unsigned int gapBelow;
+} irsignature_t;
+
+#define SIG_NOLEN     0xFFFF
+
+#ifdef IR_STREAM_DECODE
+// Decoding of a frame in the ISR, see ir_streamEdge()
+// Every pulse protocol whose signature accepts the header gets a candidate,
+// in the order of ir_signatures[]. A candidate follows the frame one entry
+// at a time and is dropped at the first entry that does not match.
+// A candidate that completes while one before it still runs waits in done
+// until those fail or the space after it gets longer than any of them
+// allows (wait).
+#define STREAM_CANDIDATES 4
+
+typedef struct {
+  const irpulse_t *proto;      // 0 once the frame did not match
+  unsigned char phase;         // STREAM_* entry that is expected next
+  unsigned char nbits;         // bits received so far
+  unsigned long data;
+  unsigned int address;
+} irstreamcand_t;
+
+typedef struct {
+  irstreamcand_t cand[STREAM_CANDIDATES];
+  unsigned char count;         // candidates of the running frame
+  unsigned char done;          // 1 + index of the complete candidate, 0 if none
+  unsigned int wait;           // longest space the candidates before it accept
+  unsigned int gap;            // rawbuf[0] and rawbuf[1] of the running frame
+  unsigned int mark;
+} irstream_t;
+
+// Frame decoded by the ISR
+typedef struct {
+  int decode_type;             // UNKNOWN if ir_decode() has to decode the frame
+  unsigned int address;
+  unsigned long value;
+  int bits;
+} irstreamresult_t;
+
+#define STREAM_FIXED     0
+#define STREAM_DATA      1
+#define STREAM_SEPMARK   2
+#define STREAM_SEPSPACE  3
+#define STREAM_RPT       4     // the fixed half that ends a PULSE_RPT_SHORT frame
+#endif
+
+#ifdef IR_EARLY_END
+// End of frame rule of a header for the ISR, see ir_endEdge()
+// The rules of all rows that accept the header are combined, so a frame
+// only ends early if none of the protocols could still go on.
+typedef struct {
+  unsigned int markLow, markHigh;
+  unsigned int spaceLow, spaceHigh;
+  unsigned char count;         // rawlen of a complete frame
+  unsigned char gapFrom;       // rawlen from which on gap applies
+  unsigned int longGap;        // end gap in ticks before gapFrom
+  unsigned int gap;            // end gap in ticks from gapFrom on
+} irframeend_t;
+
+// end gap just above the longest space of a protocol
+#define END_GAP(us) TICKS_HIGH((us) - MARK_EXCESS)
+#define FRAME_GAP_TICKS (irparams.endgap)
+#else
+#define FRAME_GAP_TICKS GAP_TICKS
+#endif
+
+// a space longer than SPACE_END_TICKS ends the frame for SPACE_END_REASON
+#ifdef IR_STREAM_DECODE
+#define SPACE_END_TICKS (irparams.stream.done && irparams.stream.wait < FRAME_GAP_TICKS ? \
+                         irparams.stream.wait : FRAME_GAP_TICKS)
+#define SPACE_END_REASON ir_streamGap()
+#else
+#define SPACE_END_TICKS FRAME_GAP_TICKS
+#define SPACE_END_REASON IR_END_GAP
+#endif
+
+// the ISR follows each frame entry by entry
+#if defined(IR_STREAM_DECODE) || defined(IR_EARLY_END)
+#define IR_RX_FOLLOW
+#endif
 
 // receiver states
 #define STATE_IDLE     2
@@ -136,6 +291,22 @@
 
 #define TOPBIT 0x80000000
 
+#ifdef IR_TX_LISTEN
+#if IR_RX_BACKEND != IR_RX_POLL
+#error "IR_TX_LISTEN needs the polling receiver"
+#endif
+#define TX_ECHO_MARK   0xFF
+#define TX_ECHO_GUARD  (IR_TX_GUARD / USECPERTICK + 1)
+#define TX_SENDING     1
+#define TX_COLLIDED    2
+#endif
+
+// frame slots of the receiver, head and tail run freely over 256
+#if RAWFRAMES < 1 || RAWFRAMES > 128 || (RAWFRAMES & (RAWFRAMES - 1)) != 0
+#error "RAWFRAMES has to be a power of two up to 128"
+#endif
+#define RAWFRAMES_MASK (RAWFRAMES - 1)
+
 
 // information for the interrupt handler
 typedef struct {
@@ -143,184 +314,339 @@ typedef struct {
   unsigned char rcvstate;          // state machine
   unsigned char blinkflag;         // TRUE to enable blinking of pin 13 on IR processing
   unsigned int timer;     // state timer, counts 50uS ticks.
-  unsigned int rawbuf[RAWBUF]; // raw data
-  unsigned int rawlen;         // counter of entries in rawbuf
+  rawbuf_t rawbuf[RAWFRAMES][RAWBUF]; // raw data, one slot per frame
+  unsigned int rawlens[RAWFRAMES]; // number of entries of each received frame
+  volatile rawbuf_t *rawcur;   // slot that is currently recorded
+#ifdef IR_RAWBUF_COMPACT
+  unsigned int rawlongs[RAWFRAMES][RAWLONG]; // durations that do not fit in rawbuf
+  volatile unsigned int *longcur; // rawlongs of the slot that is currently recorded
+  unsigned char longlen;       // counter of entries in longcur
+#endif
+  unsigned int rawlen;         // counter of entries in rawcur
+  unsigned char head;          // frames published by the ISR, head & RAWFRAMES_MASK is recorded
+  unsigned char tail;          // frames released by ir_resume(), tail & RAWFRAMES_MASK is the oldest
+  unsigned char peak;          // highest value of head - tail
+  unsigned int overflows;      // frames lost while all slots were in use
+  unsigned int overflowbase;   // overflows at the last ir_resetOverflowCount()
+  unsigned char endreasons[RAWFRAMES]; // IR_END_* of each received frame
+#ifdef IR_RX_FOLLOW
+  unsigned char endnow;        // IR_END_* if the frame has to end after the current entry
+#endif
+#ifdef IR_STREAM_DECODE
+  irstream_t stream;           // decoder state of the frame that is recorded
+  irstreamresult_t streamres[RAWFRAMES]; // result of each frame, if decoded by the ISR
+#endif
+#ifdef IR_EARLY_END
+  unsigned int endmark;        // header mark of the frame that is recorded
+  unsigned char endcount;      // rawlen at which the frame ends, 0 if unknown
+  unsigned char endfrom;       // rawlen from which on endlate applies
+  unsigned int endgap;         // current end gap in ticks
+  unsigned int endlate;        // end gap from endfrom on
+#endif
+#ifdef IR_TX_LISTEN
+  unsigned char txecho;        // TX_ECHO_MARK while our carrier is on, then ticks of guard left
+  unsigned char txactive;      // TX_SENDING while sending, TX_COLLIDED once a collision was counted
+  unsigned int collisions;     // sends a foreign mark was received during
+#endif
+#if IR_RX_BACKEND == IR_RX_EDGE
+  unsigned char rcvlevel;      // detector level after the last edge
+  unsigned int lastedge;       // Timer3 value of the last edge (or compare point)
+  unsigned int armticks;       // ticks until the armed CCP2 compare fires
+#endif
 } 
 irparams_t;
 
 // Defined in IRremote.c
 extern volatile irparams_t irparams;
 
+#if defined(IR_TX_ASYNC) || defined(IR_WAVECACHE)
+#define IR_WAVE
+#endif
+
+#ifdef IR_WAVE
+// a frame ready to send
+typedef struct {
+  unsigned char khz;           // carrier
+  unsigned char len;           // number of entries
+  unsigned char marks[(IR_TXBUF + 7) / 8]; // bit i is set if entry i is a mark
+  unsigned int reload[IR_TXBUF]; // Timer1 reload value of each entry
+} irwave_t;
+#endif
+
+#ifdef IR_WAVECACHE
+typedef struct {
+  ir_code_t code;              // code the waveform was encoded from
+  unsigned char valid;
+  irwave_t wave;
+} irwavecache_t;
+#endif
+
+#ifdef IR_TX_ASYNC
+#if IR_TXQUEUE < 1 || IR_TXQUEUE > 128 || (IR_TXQUEUE & (IR_TXQUEUE - 1)) != 0
+#error "IR_TXQUEUE has to be a power of two up to 128"
+#endif
+#define TXQUEUE_MASK (IR_TXQUEUE - 1)
+
+// information for the transmit interrupt
+typedef struct {
+  irwave_t wave[IR_TXQUEUE];   // frames built by ir_txBegin(), one per slot
+  const irwave_t *send[IR_TXQUEUE]; // frame each slot sends
+  unsigned char head;          // frames queued, head & TXQUEUE_MASK is built
+  unsigned char tail;          // frames sent, tail & TXQUEUE_MASK is sent right now
+  unsigned char pos;           // next entry of the frame that is sent
+  unsigned char busy;          // Timer1 interrupt is running
+#if IR_CHANNELS > 1
+  unsigned char chan[IR_TXQUEUE]; // channel of each slot, TX_CHANNEL_SENT if sent in a gap
+  unsigned char lend;          // slot + 1 of the frame sent in the gap of the sequence, 0 if none
+#endif
+  void (*callback)(void);      // called when the queue has run empty
+  const ir_seqentry_t *seq;    // entry of the running sequence, 0 if none
+  unsigned char seqslot;       // slot the sequence is sent from
+  unsigned char seqleft;       // entries left, including seq
+  unsigned char seqtimes;      // sends of seq left
+  unsigned char seqstate;      // SEQ_FRAME, SEQ_GAP or SEQ_NEXT
+  unsigned char seqhold;       // the key of ir_holdStart() is held
+  unsigned long seqgap;        // microseconds of the gap left
+  unsigned long seqperiod;     // microseconds from frame start to frame start, 0 if the gap of the entry applies
+  unsigned long seqframe;      // length of the frame in the slot, if seqperiod is used
+  void (*seqdone)(void);       // called when the sequence has ended
+} irtx_t;
+#define TX_CHANNEL_SENT 0xFF
+
+// states of a sequence
+#define SEQ_FRAME 1 // the frame is sent
+#define SEQ_GAP   2 // the gap is sent
+#define SEQ_NEXT  3 // the gap is sent, the next entry has to be recorded
+
+// ir_seqService() results, besides SEQ_FRAME
+#define SEQ_WAIT  4 // a piece of the gap is running
+#define SEQ_DONE  5 // the sequence has ended
+#define SEQ_LEND  6 // a queued frame of another channel is sent in the gap
+
+extern volatile irtx_t irtx;
+#endif
+
+#ifdef IR_STATS
+// counters of IR_STATS, ir_getStats() hands them out
+typedef struct {
+  unsigned long isrCalls;      // ir_interruptService() calls
+  unsigned int isrMax;         // longest call in ir_statsTimerRead() ticks
+  unsigned int rawFull;        // frames ended with IR_END_FULL
+  unsigned int overflowbase;   // irparams.overflows at the last ir_resetStats()
+  unsigned int decoded[SIGMA + 1]; // frames per decode_type, UNKNOWN in 0
+  unsigned int failed;         // frames ir_decode() threw away
+  unsigned int txFrames;       // frames sent
+  unsigned long txTicks;       // Timer1 ticks of the marks and spaces sent
+} irstats_t;
+
+extern volatile irstats_t irstats;
+
+#define IR_STATS_DECODED(type)     (irstats.decoded[(type) < 0 ? 0 : (type)]++)
+#define IR_STATS_TX_FRAME()        (irstats.txFrames++)
+#define IR_STATS_TX_RELOAD(reload) (irstats.txTicks += (unsigned int)(0u - (reload)))
+#define IR_STATS_TX_US(us)         (irstats.txTicks += (unsigned long)(us) * DELAY_TICKS_PER_US)
+#else
+#define IR_STATS_DECODED(type)
+#define IR_STATS_TX_FRAME()
+#define IR_STATS_TX_RELOAD(reload)
+#define IR_STATS_TX_US(us)
+#endif
+
 
 ////////////////////////////////////////////////////////////
 // internal Prototypes                                    //
 ////////////////////////////////////////////////////////////
 
-static void ir_delayMicroseconds(int time);
+static void ir_delayMicroseconds(unsigned long time);
 static void ir_pinMode(unsigned int pin, unsigned mode);
 static unsigned ir_digitalRead(unsigned int pin);
 static void ir_digitalWrite(unsigned int pin, unsigned value);
-static void ir_timerCfgNorm(void);
 static void ir_timerCfgKhz(unsigned char val);
+static void ir_delayReload(unsigned int reload);
+static void ir_delayStart(void);
+static void ir_delayAdd(unsigned int reload);
+static void ir_delayStop(void);
+#if IR_RX_BACKEND != IR_RX_EDGE
+static void ir_timerCfgNorm(void);
 static void ir_timerRst(void);
+#endif
+static void ir_rxService(void);
+static void ir_frameDone(unsigned char reason);
+// Ticks of a compact entry, bytes from RAW_ESC on refer to the long table
+#define ir_rawEntry(raw, longs) ((raw) >= RAW_ESC ? (longs)[(raw) - RAW_ESC] : (unsigned int)(raw))
+#ifdef IR_RAWBUF_COMPACT
+static void ir_rawStore(unsigned int ticks);
+#else
+#define ir_rawStore(ticks) (irparams.rawcur[irparams.rawlen++] = (ticks))
+#endif
+#ifdef IR_RX_FOLLOW
+static void ir_rxStore(unsigned int ticks);
+#else
+#define ir_rxStore(ticks) ir_rawStore(ticks)
+#endif
+#ifdef IR_STREAM_DECODE
+static void ir_streamEdge(unsigned int ticks);
+static unsigned char ir_streamGap(void);
+#endif
+#ifdef IR_EARLY_END
+static void ir_endEdge(unsigned int ticks);
+#endif
+static void ir_frameCheckFree(void);
+#if IR_RX_BACKEND == IR_RX_EDGE
+static void ir_timerCfgEdge(void);
+static unsigned int ir_edgeTimerRead(void);
+static void ir_edgeArm(unsigned int ticks);
+#endif
+#ifndef IR_TX_ASYNC
 static void ir_enableIROut(int khz);
+#endif
+#if IR_CHANNELS > 1
+static void ir_channelSelect(unsigned char channel);
+#endif
+static unsigned char ir_packFind(const unsigned int refs[], unsigned char marks, unsigned char n, unsigned int ticks, unsigned char mark);
+static void ir_txBegin(int khz);
+static void ir_txEnd(void);
 static void ir_mark(int time);
 static void ir_space(int time);
-static int ir_getRClevel(decode_results *results, int *offset, int *used, int t1);
-static long ir_decodeNEC(decode_results *results);
-static long ir_decodeSigma(decode_results *results);
-static long ir_decodeSony(decode_results *results);
-static long ir_decodeSanyo(decode_results *results);
-static long ir_decodeMitsubishi(decode_results *results);
+static void ir_pause(unsigned int time);
+#ifdef IR_WAVE
+static void ir_waveStart(irwave_t *wave, int khz);
+static void ir_waveAppend(irwave_t *wave, unsigned char level, unsigned long time);
+static int ir_waveEncodeCode(irwave_t *wave, const ir_code_t *code, unsigned char repeat);
+#endif
+#ifdef IR_TX_ASYNC
+static unsigned long ir_waveLength(const irwave_t *wave);
+static irwave_t *ir_txSlot(void);
+static void ir_txQueue(const irwave_t *wave);
+static void ir_txService(void);
+static int ir_seqStart(const ir_seqentry_t *entries, unsigned char count, unsigned long period, void (*done)(void));
+static unsigned char ir_seqService(void);
+#if IR_CHANNELS > 1
+static unsigned char ir_seqLend(void);
+#endif
+static void ir_txTimerCfg(void);
+static void ir_txTimerStop(void);
+#elif defined(IR_WAVECACHE)
+static void ir_sendWave(const irwave_t *wave);
+#endif
+static int ir_getRClevel(decode_results *results, int *offset, int *used, const rclevel_t *t1);
+static long ir_decodePulse(decode_results *results, const irpulse_t *proto);
 static long ir_decodeRC5(decode_results *results);
 static long ir_decodeRC6(decode_results *results);
-static long ir_decodePanasonic(decode_results *results);
-static long ir_decodeJVC(decode_results *results);
 static long ir_decodeHash(decode_results *results);
+static long ir_decodeSignatures(decode_results *results);
 static int ir_compare(unsigned int oldval, unsigned int newval);
-static int MATCH(int measured, int desired);
-static int MATCH_MARK(int measured_ticks, int desired_us);
-static int MATCH_SPACE(int measured_ticks, int desired_us);
+static int ir_match(unsigned int measured, unsigned int low, unsigned int high);
 
 ////////////////////////////////////////////////////////////
-// PIC2550 hardware depending defines                     //
+// hardware abstraction                                   //
 ////////////////////////////////////////////////////////////
 
-// cpu speed
-#define SYSCLOCK 12000000    // TCY - instructions per second of pic
+// The library reaches the hardware only through its backend header:
+// - SYSCLOCK, DELAY_PRESCALE, EDGE_PRESCALE: clocks of the timers
+// - CARRIER_ON, CARRIER_OFF, ir_timerCfgKhz(): the carrier on TIMER_PWM_PIN,
+//   with the register values of ir_carrierCfg()
+// - ir_delayStart(), ir_delayAdd(), ir_delayStop(), ir_delayReload(),
+//   DELAY_RUNNING, DELAY_ADD_TICKS: Timer1 that times marks and spaces
+// - ir_txTimerCfg(), ir_txTimerStop(), TX_INT_PENDING: its interrupt
+// - ir_timerCfgNorm(), ir_timerRst(), TIMER_INT_FLAG, TIMER_INT_PENDING:
+//   the 50us sample timer of the polling receiver
+// - ir_timerCfgEdge(), ir_edgeTimerRead(), ir_edgeArm(), EDGE_*: the edge
+//   receiver
+// - TIMER_ENABLE_INTR, TIMER_DISABLE_INTR, DISABLE_INTERRUPTS,
+//   ENABLE_INTERRUPTS: interrupt masks
+// - ir_pinMode(), ir_digitalRead(), ir_digitalWrite(), BLINKLED_*,
+//   IR_RECEIVE_PIN: pins
+// - IR_BARRIER(), IR_WAIT(): ISR handoff and the body of busy loops
+// - IR_COUNT_DECODER(), IR_COUNT_MATCH(): decoder profiling, empty on the PIC
+// - ir_statsTimerCfg(), ir_statsTimerRead(): free running time base of
+//   IR_STATS
+// IRremotePic18.h drives the PIC18F2550. With IR_HOST, IRremoteHost.h
+// simulates it on a PC with a virtual clock instead.
+
+// timing derived from the backend clocks
 #define USECPERTICK 50       // microseconds per clock interrupt tick
-
-// defines for timers
-#define MAX_TMR_VAL          65535
 #define US_PER_SEC           1000000
-#define TIMER_ENABLE_PWM     (CCPR1L=half_pwm)
-#define TIMER_DISABLE_PWM    (CCPR1L=0)
-#define TIMER_ENABLE_INTR    (PIE2bits.TMR3IE=1)   
-#define TIMER_DISABLE_INTR   (PIE2bits.TMR3IE=0)
-#define TIMER_INT_FLAG       PIR2bits.TMR3IF
-#define TIMER_PWM_PIN        13
-#define DELAY_INT_FLAG       PIR1bits.TMR1IF
-#define DELAY_PRESCALE       4
 #define DELAY_TICKS_PER_US   (SYSCLOCK/US_PER_SEC/DELAY_PRESCALE)
+// Timer1 runs through a whole frame, each mark or space is chained to the
+// previous one by adding its reload value (the negative tick count) to TMR1.
+// Timer1 interrupts when it rolls over from 65535 to 0.
+#define IR_RELOAD(us)        ((unsigned int)(0u - (us)*DELAY_TICKS_PER_US))
+#define TX_CHUNK             20000u // longest Timer1 period in microseconds, longer ones are split
+#define DELAY_MIN_US         5      // shorter periods are lengthened to this
+#define EDGE_TMR_PER_TICK    (USECPERTICK*(SYSCLOCK/US_PER_SEC)/EDGE_PRESCALE)
+#define EDGE_TO_TICKS(cnt)   (((cnt) + EDGE_TMR_PER_TICK/2) / EDGE_TMR_PER_TICK)
+#define EDGE_IDLE_TICKS      436   // compare interval while no frame is running (21.8ms)
+#define EDGE_IDLE_LIMIT      (0xFFFF - EDGE_IDLE_TICKS)
+
+#ifdef IR_TX_LISTEN
+#define TIMER_ENABLE_PWM     (irparams.txecho=TX_ECHO_MARK, CARRIER_ON)
+#define TIMER_DISABLE_PWM    (CARRIER_OFF, irparams.txecho=TX_ECHO_GUARD)
+#else
+#define TIMER_ENABLE_PWM     CARRIER_ON
+#define TIMER_DISABLE_PWM    CARRIER_OFF
+#endif
+#ifdef IR_TX_LISTEN
+#define TX_RX_MUTE           (irparams.txactive=TX_SENDING)
+#define TX_RX_UNMUTE         (irparams.txactive=0)
+#else
+#define TX_RX_MUTE           TIMER_DISABLE_INTR
+#define TX_RX_UNMUTE         TIMER_ENABLE_INTR
+#endif
 
-// defines for blinking the LED
-#define BLINKLED_PIN         2
-#define BLINKLED_ON()        (LATAbits.LATA0 = 1)
-#define BLINKLED_OFF()       (LATAbits.LATA0 = 0)
-
-#define IR_RECEIVE_PIN       25
+#if IR_DUTY < 1 || IR_DUTY > 100
+#error "IR_DUTY has to be 1 to 100"
+#endif
+static unsigned char carrier_khz = 0;       // carrier that is set up, 0 if none
+static unsigned char carrier_duty = IR_DUTY; // duty cycle in percent
 
-#define DISABLE_INTERRUPTS   (INTCONbits.GIEH = 0)
-#define ENABLE_INTERRUPTS    (INTCONbits.GIEH = 1)
+// Timer2 and CCP1 setup of a carrier, see ir_carrierCfg()
+typedef struct {
+  unsigned char ckps;          // T2CKPS, prescale 1 << (2 * ckps)
+  unsigned int steps;          // PR2 + 1
+  unsigned char duty;          // CCPR1L while the carrier is on
+} ircarrier_t;
+static void ir_carrierCfg(ircarrier_t *cfg, unsigned char khz);
+
+#ifdef IR_HOST
+#include "IRremoteHost.h"
+#else
+#include "IRremotePic18.h"
+#endif
 
 ////////////////////////////////////////////////////////////
-// PIC2550 hardware depending functions                   //
+// hardware independent timing functions                  //
 ////////////////////////////////////////////////////////////
 
-volatile unsigned char half_pwm = 0;
-
-static void ir_timerRst(void) {
-    /*timer 3 for ir-receiving*/
-    TMR3H = (MAX_TMR_VAL - (USECPERTICK*(SYSCLOCK/US_PER_SEC)))/256;
-    TMR3L = (MAX_TMR_VAL - (USECPERTICK*(SYSCLOCK/US_PER_SEC)))%256;
-}
-
-static void ir_timerCfgNorm(void) {
-  /*timer 3 for ir-receiving*/
-  INTCONbits.GIEL = 1; //enable low prio
-  T3CON = 0b10000100;
-  TMR3H = (MAX_TMR_VAL - (USECPERTICK*(SYSCLOCK/US_PER_SEC)))/256;
-  TMR3L = (MAX_TMR_VAL - (USECPERTICK*(SYSCLOCK/US_PER_SEC)))%256;
-  PIR2bits.TMR3IF = 0;
-  IPR2bits.TMR3IP = 1;
-  T3CONbits.TMR3ON = 1;
-}
-
-
-static void ir_timerCfgKhz(unsigned char val) {
-  const unsigned char pwmval = SYSCLOCK / 4000 / val;
-  /*timer 2 in PWM mode for carrier freq during ir-sending*/
-  PIR1bits.TMR2IF=0;
-  IPR1bits.TMR2IP=1;
-  PIE1bits.TMR2IE=0;
-  PR2 = pwmval;
-  CCPR1L = 0;
-  half_pwm  = pwmval / 2;
-  CCP1CON = 0b00001100;
-  T2CON = 0x01;
-  T2CONbits.TMR2ON=1;
-}
-
-static void ir_digitalWrite(unsigned int pin, unsigned value)
-{
-    switch(pin)
-    {
-        case 2:
-            LATAbits.LATA0 = value;
-        case 13:
-            LATCbits.LATC2 = value;
-        // define more pins of Pic here if needed...
-        default:
-            return;
-    }
-}
-
-static unsigned ir_digitalRead(unsigned int pin)
-{
-    switch(pin)
-    {
-        case 23:
-            return PORTBbits.RB2;
-        case 25:
-            return PORTBbits.RB4;
-        // define more pins of Pic here if needed...
-        default:
-            return 0;
-    }
-}
-
-static void ir_pinMode(unsigned int pin, unsigned mode)
+static void ir_delayMicroseconds(unsigned long time)
 {
-    switch(pin)
-    {
-        case 2:
-            TRISAbits.TRISA0 = mode;
-            break;
-        case 13:
-            TRISCbits.TRISC2 = mode;
-            break;
-        case 23:
-            TRISBbits.TRISB2 = mode;
-            break;
-        case 25:
-            TRISBbits.TRISB4 = mode;
-            break;
-        // define more pins of Pic here if needed...
-        default:
-            break;
+    unsigned int part;
+    while (time > 0) {
+        part = time > TX_CHUNK ? TX_CHUNK : (unsigned int)time;
+        time -= part;
+        if (part < DELAY_MIN_US) {
+            part = DELAY_MIN_US;
+        }
+        ir_delayReload(IR_RELOAD(part));
     }
 }
 
-static void ir_delayMicroseconds(int time)
-{
-    unsigned long tm_val = MAX_TMR_VAL - (time*DELAY_TICKS_PER_US);
-    /*using timer 1 for a delay during ir-sending*/
-    T1CON = 0b10100100; /*16bit timer using a prescale of 4*/
-    TMR1H = tm_val/256;
-    TMR1L = tm_val%256;
-    DELAY_INT_FLAG = 0;//clear interrupt flag
-    IPR1bits.TMR1IP = 1;//set to high prio
-    INTCONbits.GIEH = 1;//enable high prio
-    INTCONbits.GIEL = 1;//enable low prio
-    T1CONbits.TMR1ON = 1;// start timer
-    while(DELAY_INT_FLAG == 0){};//wait for timer interrupt flag
-    T1CONbits.TMR1ON = 0;// disable timer
-}
-
-static void ir_delay(unsigned long time)
+unsigned char ir_delay(unsigned long time)
 {
     unsigned long i;
+    unsigned char running = 0;
+#ifdef IR_TX_ASYNC
+    // Timer1 sends the queue, wait until it is free
+    if (!ir_txWait()) {
+        return 0;
+    }
+#endif
+    running = DELAY_RUNNING;
     for(i=0; i<time; i++) ir_delayMicroseconds(1000);
+    if (!running) {
+        ir_delayStop();
+    }
+    return 1;
 }
 
 #endif
@@ -0,0 +1,301 @@
+/*
+ * IRremote
+ * Version 0.1 July, 2009
+ * Copyright 2009 Ken Shirriff
+ * For details, see http://arcfn.com/2009/08/multi-protocol-infrared-remote-library.html
+ *
+ * Modified by Paul Stoffregen <paul@pjrc.com> to support other boards and timers
+ * Ported to PIC18F2550 by Marco Koehler, 2013
+ *
+ * Interrupt code based on NECIRrcv by Joe Knapp
+ * http://www.arduino.cc/cgi-bin/yabb2/YaBB.pl?num=1210243556
+ * Also influenced by http://zovirl.com/2008/11/12/building-a-universal-remote-with-an-arduino/
+ *
+ * JVC and Panasonic protocol added by Kristian Lauszus (Thanks to zenwheel and other people at the original blog post)
+ */
+
+#ifndef IRremotePic18_h
+#define IRremotePic18_h
+
+// PIC18F2550 backend of the hardware abstraction in IRremoteInt.h
+
+#include "p18f2550.h"
+
+////////////////////////////////////////////////////////////
+// PIC2550 hardware depending defines                     //
+////////////////////////////////////////////////////////////
+
+// cpu speed
+#define SYSCLOCK 12000000    // TCY - instructions per second of pic
+
+// defines for timers
+#define MAX_TMR_VAL          65535
+#define CARRIER_ON           (CCPR1L=duty_pwm)
+#define CARRIER_OFF          (CCPR1L=0)
+#if IR_RX_BACKEND == IR_RX_EDGE
+#define TIMER_ENABLE_INTR    (INTCONbits.RBIE=1)
+#define TIMER_DISABLE_INTR   (INTCONbits.RBIE=0)
+#else
+#define TIMER_ENABLE_INTR    (PIE2bits.TMR3IE=1)   
+#define TIMER_DISABLE_INTR   (PIE2bits.TMR3IE=0)
+#endif
+#define TIMER_INT_FLAG       PIR2bits.TMR3IF
+#define TIMER_INT_PENDING    (PIE2bits.TMR3IE && PIR2bits.TMR3IF)
+#define TIMER_PWM_PIN        13
+#define DELAY_INT_FLAG       PIR1bits.TMR1IF
+#define DELAY_RUNNING        T1CONbits.TMR1ON
+#define DELAY_PRESCALE       4
+// Ticks Timer1 misses while ir_delayAdd() writes it. TMR1 goes on counting
+// from the read of TMR1L until TMR1L is written, an estimated 8
+// instruction cycles, and a tick is 4 cycles at prescale 4. The write also
+// clears the prescaler, which loses the 0 to 3 cycles it had counted at
+// the read. A wrong value makes every mark and space a third of a
+// microsecond long or short per tick. To measure it, send ir_sendNEC(0, 32)
+// with a logic analyser on the carrier: from the start of the first mark
+// to the end of the stop mark it has to last 49900us, each tick off adds
+// 67 * 0.33us = 22us. host/timing.c models both losses (HOST_T1_WRITE_CYCLES,
+// HOST_T1_READ_CYCLES): a NEC frame is 45us long with 0, exact with 2 and
+// 22us short with 3, and a prescaler 2 cycles into a tick adds 11us.
+#ifndef DELAY_ADD_TICKS
+#define DELAY_ADD_TICKS      2
+#endif
+#define TX_INT_PENDING       (PIE1bits.TMR1IE && PIR1bits.TMR1IF)
+
+// defines for blinking the LED
+#define BLINKLED_PIN         2
+#define BLINKLED_ON()        (LATAbits.LATA0 = 1)
+#define BLINKLED_OFF()       (LATAbits.LATA0 = 0)
+
+#define IR_RECEIVE_PIN       25
+
+// defines for the edge receive backend
+// Timer3 runs free with a prescale of 8, CCP2 compares against it
+#define EDGE_PRESCALE        8
+#define EDGE_INT_FLAG        INTCONbits.RBIF
+#define EDGE_INT_PENDING     (INTCONbits.RBIE && INTCONbits.RBIF)
+#define EDGE_TIMEOUT_FLAG    PIR2bits.CCP2IF
+#define EDGE_TIMEOUT_PENDING (PIE2bits.CCP2IE && PIR2bits.CCP2IF)
+#define EDGE_TIMEOUT_DISABLE (PIE2bits.CCP2IE=0)
+
+#define DISABLE_INTERRUPTS   (INTCONbits.GIEH = 0)
+#define ENABLE_INTERRUPTS    (INTCONbits.GIEH = 1)
+
+// XC8 keeps the order of volatile accesses and the PIC has a single core,
+// so the ISR/application handoff needs no further barrier
+#define IR_BARRIER()
+// busy loops just spin until an interrupt has done the work
+#define IR_WAIT()
+// no profiling on the PIC
+#define IR_COUNT_DECODER(type)
+#define IR_COUNT_MATCH()
+
+volatile unsigned char duty_pwm = 0;
+
+#if IR_RX_BACKEND != IR_RX_EDGE
+static void ir_timerRst(void) {
+    /*timer 3 for ir-receiving*/
+    TMR3H = (MAX_TMR_VAL - (USECPERTICK*(SYSCLOCK/US_PER_SEC)))/256;
+    TMR3L = (MAX_TMR_VAL - (USECPERTICK*(SYSCLOCK/US_PER_SEC)))%256;
+}
+
+static void ir_timerCfgNorm(void) {
+  /*timer 3 for ir-receiving*/
+  INTCONbits.GIEL = 1; //enable low prio
+  T3CON = 0b10000100;
+  TMR3H = (MAX_TMR_VAL - (USECPERTICK*(SYSCLOCK/US_PER_SEC)))/256;
+  TMR3L = (MAX_TMR_VAL - (USECPERTICK*(SYSCLOCK/US_PER_SEC)))%256;
+  PIR2bits.TMR3IF = 0;
+  IPR2bits.TMR3IP = 1;
+  T3CONbits.TMR3ON = 1;
+}
+#endif
+
+#if IR_RX_BACKEND == IR_RX_EDGE
+static void ir_timerCfgEdge(void) {
+  /*timer 3 free running for edge time stamps, CCP2 compares against it*/
+  INTCONbits.GIEL = 1; //enable low prio
+  T3CON = 0b10111000; /*16bit, prescale of 8, timer 3 is clock source for CCP2*/
+  TMR3H = 0;
+  TMR3L = 0;
+  CCP2CON = 0b00001010; /*compare mode, software interrupt only*/
+  PIR2bits.CCP2IF = 0;
+  IPR2bits.CCP2IP = 1;
+  /*RB4 port change interrupt for the detector edges*/
+  INTCON2bits.RBIP = 1;
+  INTCONbits.RBIF = 0;
+  T3CONbits.TMR3ON = 1;
+}
+
+static unsigned int ir_edgeTimerRead(void) {
+  /*reading TMR3L latches TMR3H in 16bit mode*/
+  unsigned char lo = TMR3L;
+  return ((unsigned int)TMR3H << 8) | lo;
+}
+
+static void ir_edgeArm(unsigned int ticks) {
+  unsigned int cmp = irparams.lastedge + ticks * EDGE_TMR_PER_TICK;
+  irparams.armticks = ticks;
+  CCPR2H = cmp/256;
+  CCPR2L = cmp%256;
+  PIR2bits.CCP2IF = 0;
+  PIE2bits.CCP2IE = 1;
+}
+#endif
+
+#ifdef IR_STATS
+static void ir_statsTimerCfg(void) {
+  /*timer 0 free running at the instruction clock to time the interrupt*/
+  T0CON = 0b10001000; /*on, 16bit, internal clock, no prescaler*/
+}
+
+static unsigned int ir_statsTimerRead(void) {
+  /*reading TMR0L latches TMR0H*/
+  unsigned char lo = TMR0L;
+  return ((unsigned int)TMR0H << 8) | lo;
+}
+#endif
+
+#ifdef IR_TX_ASYNC
+static void ir_txTimerCfg(void) {
+  /*timer 1 interrupt at the end of each mark or space during ir-sending*/
+  ir_delayStart();
+  PIE1bits.TMR1IE = 1;
+}
+
+static void ir_txTimerStop(void) {
+  ir_delayStop();
+  PIE1bits.TMR1IE = 0;
+  DELAY_INT_FLAG = 0;
+}
+#endif
+
+static void ir_timerCfgKhz(unsigned char val) {
+  ircarrier_t cfg;
+  if (val == carrier_khz) {
+    return; // already set up
+  }
+  ir_carrierCfg(&cfg, val);
+  /*timer 2 in PWM mode for carrier freq during ir-sending*/
+  PIR1bits.TMR2IF=0;
+  IPR1bits.TMR2IP=1;
+  PIE1bits.TMR2IE=0;
+  PR2 = cfg.steps - 1;
+  CCPR1L = 0;
+  duty_pwm = cfg.duty;
+  CCP1CON = 0b00001100;
+  T2CON = cfg.ckps;
+  T2CONbits.TMR2ON=1;
+  carrier_khz = val;
+}
+
+static void ir_digitalWrite(unsigned int pin, unsigned value)
+{
+    switch(pin)
+    {
+        case 2:
+            LATAbits.LATA0 = value;
+            break;
+        case 13:
+            LATCbits.LATC2 = value;
+            break;
+        case 21:
+            LATBbits.LATB0 = value;
+            break;
+        case 22:
+            LATBbits.LATB1 = value;
+            break;
+        case 23:
+            LATBbits.LATB2 = value;
+            break;
+        case 24:
+            LATBbits.LATB3 = value;
+            break;
+        // define more pins of Pic here if needed...
+        default:
+            return;
+    }
+}
+
+static unsigned ir_digitalRead(unsigned int pin)
+{
+    switch(pin)
+    {
+        case 23:
+            return PORTBbits.RB2;
+        case 25:
+            return PORTBbits.RB4;
+        // define more pins of Pic here if needed...
+        default:
+            return 0;
+    }
+}
+
+static void ir_pinMode(unsigned int pin, unsigned mode)
+{
+    switch(pin)
+    {
+        case 2:
+            TRISAbits.TRISA0 = mode;
+            break;
+        case 13:
+            TRISCbits.TRISC2 = mode;
+            break;
+        case 21:
+            TRISBbits.TRISB0 = mode;
+            break;
+        case 22:
+            TRISBbits.TRISB1 = mode;
+            break;
+        case 23:
+            TRISBbits.TRISB2 = mode;
+            break;
+        case 24:
+            TRISBbits.TRISB3 = mode;
+            break;
+        case 25:
+            TRISBbits.TRISB4 = mode;
+            break;
+        // define more pins of Pic here if needed...
+        default:
+            break;
+    }
+}
+
+static void ir_delayStart(void)
+{
+    /*timer 1 runs through the frame, ir_delayAdd() chains the periods*/
+    T1CON = 0b10100100; /*16bit timer using a prescale of 4*/
+    TMR1H = 0;
+    TMR1L = 0;
+    DELAY_INT_FLAG = 0;//clear interrupt flag
+    IPR1bits.TMR1IP = 1;//set to high prio
+    INTCONbits.GIEH = 1;//enable high prio
+    INTCONbits.GIEL = 1;//enable low prio
+    T1CONbits.TMR1ON = 1;// start timer
+}
+
+static void ir_delayAdd(unsigned int reload)
+{
+    /*the ticks since the last overflow are kept, so delays do not add up*/
+    unsigned char lo = TMR1L; /*reading TMR1L latches TMR1H in 16bit mode*/
+    unsigned int tm_val = (((unsigned int)TMR1H << 8) | lo) + reload + DELAY_ADD_TICKS;
+    TMR1H = tm_val/256;
+    TMR1L = tm_val%256;
+    DELAY_INT_FLAG = 0;//clear interrupt flag
+}
+
+static void ir_delayStop(void)
+{
+    T1CONbits.TMR1ON = 0;// disable timer
+}
+
+static void ir_delayReload(unsigned int reload)
+{
+    if (!DELAY_RUNNING) {
+        ir_delayStart();
+    }
+    ir_delayAdd(reload);
+    while(DELAY_INT_FLAG == 0){};//wait for timer interrupt flag
+}
+
+#endif
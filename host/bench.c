@@ -0,0 +1,316 @@
+/*
+ * IRremote decode benchmark for the host
+ *
+ * Replays frames through the simulated receiver (IR_HOST) and times
+ * ir_decode() on each captured rawbuf. Reports frames per second, the
+ * median and worst decode time per protocol and by rawlen, and the
+ * ir_match() calls per frame and per decoder, which stand in for the
+ * cycles the PIC would spend.
+ *
+ * The corpus is synthesized: codes of every protocol the library sends,
+ * recorded from its own senders, Sanyo and Mitsubishi frames built from
+ * their timings and random unknown frames. Trace files add real captures.
+ *
+ * Build in the library directory with the flags of the PIC build, e.g.
+ *   gcc -O2 -DIR_HOST -I. -o irbench host/bench.c host/hosttools.c IRremote.c
+ * Run
+ *   ./irbench [-r repeats] [-n codes] [trace files...]
+ *
+ * A trace file holds one frame per line: the protocol name (or ? if it is
+ * not known) and the durations in microseconds as the detector delivers
+ * them, starting with a mark. Lines starting with # are comments.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hosttools.h"
+
+#define MAX_FRAMES    4096
+#define MATCH_CYCLES  40    // rough PIC18 cycles of one ir_match() call with its arguments
+#define PIC_MIPS      12
+#define LEN_BUCKET    16
+
+typedef hostframe_t trace_t;   // detector output, the durations ir_decode() sees
+
+typedef struct {
+  int got;                     // decode_type ir_decode() found
+  int rawlen;
+  double ns;                   // fastest of the repeats
+  unsigned long matches;
+} result_t;
+
+static trace_t traces[MAX_FRAMES];
+static result_t results[MAX_FRAMES];
+static int ntraces = 0;
+
+static unsigned long seed = 1;
+static unsigned long rnd(void) {
+  seed = seed * 1103515245UL + 12345UL;
+  return (seed >> 8) & 0xFFFFFFUL;
+}
+
+////////////////////////////////////////////////////////////
+// corpus                                                 //
+////////////////////////////////////////////////////////////
+
+static trace_t *newTrace(int type) {
+  if (ntraces == MAX_FRAMES) {
+    return 0;
+  }
+  traces[ntraces].type = type;
+  traces[ntraces].len = 0;
+  return &traces[ntraces++];
+}
+
+// Records a code from the library sender as the detector would see it,
+// one trace per frame
+static void addSent(int type, unsigned long value, int bits, unsigned int address) {
+  trace_t *t;
+  int i, n = hostSend(type, value, bits, address);
+  for (i = 0; i < n && (t = newTrace(type)); i++) {
+    *t = hostParts[i];
+    hostAddLag(t, HOST_LAG_US);
+  }
+}
+
+// Frame of a pulse width protocol that the library can not send, given as
+// the durations the decoder expects: header, then a fixed and a data half
+// per bit, ending with a mark
+static void addPulse(int type, const unsigned int *hdr, int hdrLen, unsigned int fixed,
+                     unsigned int one, unsigned int zero, int dataFirst, unsigned long value, int bits) {
+  trace_t *t = newTrace(type);
+  int i;
+  if (!t) {
+    return;
+  }
+  for (i = 0; i < hdrLen; i++) {
+    t->us[t->len++] = hdr[i];
+  }
+  for (i = bits - 1; i >= 0; i--) {
+    unsigned int data = (value >> i) & 1 ? one : zero;
+    t->us[t->len++] = dataFirst ? data : fixed;
+    t->us[t->len++] = dataFirst ? fixed : data;
+  }
+  if (!(t->len & 1)) {
+    t->us[t->len++] = fixed;
+  }
+}
+
+static void addUnknown(void) {
+  trace_t *t = newTrace(UNKNOWN);
+  int n = 10 + (int)(rnd() % 50);
+  int i;
+  if (!t) {
+    return;
+  }
+  for (i = 0; i < n; i++) {
+    t->us[t->len++] = (i & 1) ? 300 + rnd() % 2700 : 300 + rnd() % 1700;
+  }
+}
+
+static void buildCorpus(int codes) {
+  static const unsigned int sanyoHdr[2] = { 3600, 3600 };
+  static const unsigned int mitsubishiHdr[1] = { 350 };
+  static const int sonyBits[3] = { 12, 15, 20 };
+  int i;
+
+  for (i = 0; i < codes; i++) {
+    addSent(NEC, i ? ((rnd() << 8) ^ rnd()) & 0xFFFFFFFFUL : REPEAT, 32, 0);
+    addSent(SONY, rnd(), sonyBits[i % 3], 0);
+    addSent(RC5, rnd() & 0xFFF, 12, 0);
+    addSent(RC6, rnd() & 0xFFFFF, 20, 0);
+    addSent(DISH, rnd() & 0xFFFF, 16, 0);
+    addSent(SHARP, rnd() & 0x7FFF, 15, 0);
+    addSent(PANASONIC, ((rnd() << 8) ^ rnd()) & 0xFFFFFFFFUL, 48, (unsigned int)(rnd() & 0xFFFF));
+    addSent(JVC, rnd() & 0xFFFF, 16, 0);
+    addSent(SIGMA, rnd() & 0xFFFF, 16, 0);
+    addPulse(SANYO, sanyoHdr, 2, 850, 2500, 800, 0, rnd() & 0xFFF, 12);
+    addPulse(MITSUBISHI, mitsubishiHdr, 1, 300, 2050, 850, 1, rnd() & 0xFFFF, 16);
+    addUnknown();
+  }
+}
+
+static void loadTraces(const char *file) {
+  char line[2048];
+  FILE *f = fopen(file, "r");
+  if (!f) {
+    perror(file);
+    exit(1);
+  }
+  while (fgets(line, sizeof(line), f)) {
+    char *tok = strtok(line, " \t\r\n");
+    trace_t *t;
+    if (!tok || tok[0] == '#') {
+      continue;
+    }
+    t = newTrace(hostTypeIndex(tok));
+    if (!t) {
+      break;
+    }
+    while ((tok = strtok(0, " \t\r\n")) && t->len < HOST_MAX_EDGES) {
+      t->us[t->len++] = (unsigned int)strtoul(tok, 0, 10);
+    }
+  }
+  fclose(f);
+}
+
+////////////////////////////////////////////////////////////
+// replay                                                 //
+////////////////////////////////////////////////////////////
+
+static unsigned long decoderMatches[HOST_TYPES];
+static unsigned long decodedFrames = 0;
+
+static void replay(const trace_t *t, result_t *r, int repeats) {
+  decode_results res;
+  double start, ns, best;
+  unsigned long matches = 0;
+  int i, type, frame;
+
+  hostPlay(t);
+
+  // a frame the receiver splits (a space longer than its gap) queues
+  // several, the longest one counts
+  r->got = UNKNOWN - 1;
+  r->rawlen = 0;
+  r->ns = 0;
+  r->matches = 0;
+  for (frame = 0; frame < RAWFRAMES; frame++) {
+    best = 0;
+    for (i = 0; i < repeats; i++) {
+      ir_hostClearMatches();
+      start = hostNsNow();
+      if (!ir_decode(&res)) {
+        // no frame, or one too short for the hash that is thrown away
+        break;
+      }
+      ns = hostNsNow() - start;
+      if (i == 0 || ns < best) {
+        best = ns;
+      }
+      if (i == 0) {
+        matches = hostMatchesNow();
+        for (type = UNKNOWN; type <= SIGMA; type++) {
+          decoderMatches[type + 1] += ir_hostMatches(type);
+        }
+        decodedFrames++;
+      }
+    }
+    if (i == 0) {
+      continue;
+    }
+    if (res.rawlen > r->rawlen) {
+      r->got = res.decode_type;
+      r->rawlen = res.rawlen;
+      r->ns = best;
+      r->matches = matches;
+    }
+    ir_resume();
+  }
+}
+
+////////////////////////////////////////////////////////////
+// report                                                 //
+////////////////////////////////////////////////////////////
+
+static int cmpDouble(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+// Prints one line for the results the filter selects
+static void report(const char *label, int (*filter)(const trace_t *, const result_t *, int), int arg) {
+  static double ns[MAX_FRAMES];
+  double sum = 0;
+  unsigned long matches = 0, rawlen = 0;
+  int i, n = 0, ok = 0;
+  for (i = 0; i < ntraces; i++) {
+    if (results[i].got < UNKNOWN || !filter(&traces[i], &results[i], arg)) {
+      continue;
+    }
+    ns[n++] = results[i].ns;
+    sum += results[i].ns;
+    matches += results[i].matches;
+    rawlen += results[i].rawlen;
+    ok += results[i].got == traces[i].type;
+  }
+  if (n == 0) {
+    return;
+  }
+  qsort(ns, n, sizeof(ns[0]), cmpDouble);
+  printf("%-11s %6d %5.1f%% %7.1f %9.0f %8.0f %9.0f %8.1f %9.0f\n", label, n, 100.0 * ok / n,
+         (double)rawlen / n, n * 1e9 / sum, ns[n / 2], ns[n - 1], (double)matches / n,
+         (double)matches / n * MATCH_CYCLES / PIC_MIPS);
+}
+
+static int byType(const trace_t *t, const result_t *r, int type) {
+  (void)r;
+  return t->type == type;
+}
+
+static int byLen(const trace_t *t, const result_t *r, int bucket) {
+  (void)t;
+  return r->rawlen / LEN_BUCKET == bucket;
+}
+
+static int all(const trace_t *t, const result_t *r, int unused) {
+  (void)t;
+  (void)r;
+  (void)unused;
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  int repeats = 20, codes = 16, i, lost = 0;
+  char label[32];
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      repeats = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      codes = atoi(argv[++i]);
+    }
+    else {
+      loadTraces(argv[i]);
+    }
+  }
+  if (repeats < 1) {
+    repeats = 1;
+  }
+
+  ir_enableIRIn();
+  ir_hostRun(HOST_FRAME_GAP * 2);
+  buildCorpus(codes);
+  for (i = 0; i < ntraces; i++) {
+    replay(&traces[i], &results[i], repeats);
+    lost += results[i].got < UNKNOWN;
+  }
+
+  printf("%d frames, %d lost by the receiver, fastest of %d decodes per frame\n\n", ntraces, lost, repeats);
+  printf("%-11s %6s %6s %7s %9s %8s %9s %8s %9s\n", "protocol", "frames", "ok", "rawlen",
+         "frames/s", "med ns", "worst ns", "matches", "~PIC us");
+  for (i = 0; i < HOST_TYPES; i++) {
+    report(hostNames[i], byType, i - 1);
+  }
+  report("all", all, 0);
+
+  printf("\n%-11s %6s %6s %7s %9s %8s %9s %8s %9s\n", "rawlen", "frames", "ok", "rawlen",
+         "frames/s", "med ns", "worst ns", "matches", "~PIC us");
+  for (i = 0; i <= RAWBUF / LEN_BUCKET; i++) {
+    sprintf(label, "%d-%d", i * LEN_BUCKET, i * LEN_BUCKET + LEN_BUCKET - 1);
+    report(label, byLen, i);
+  }
+
+  printf("\nir_match() calls per frame by decoder\n");
+  for (i = 0; i < HOST_TYPES; i++) {
+    if (decoderMatches[i]) {
+      printf("%-11s %8.2f\n", hostNames[i], (double)decoderMatches[i] / decodedFrames);
+    }
+  }
+  printf("\nok: decode_type is the protocol of the frame. DISH and SHARP have no decoder.\n");
+  printf("~PIC us: matches * %d cycles at %d MIPS, a rough estimate.\n", MATCH_CYCLES, PIC_MIPS);
+  return 0;
+}
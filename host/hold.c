@@ -0,0 +1,125 @@
+/*
+ * IRremote held key check for the host
+ *
+ * Holds a NEC key with ir_holdStart() and sends more frames while it is
+ * held. The queue does not run empty during a hold, so once all slots are
+ * in use ir_sendCode() has to return 0 instead of waiting, and so do
+ * ir_txWait(), ir_delay(), ir_sendCached() on a miss, ir_holdStart() and
+ * ir_sendSequence(). After ir_holdStop() the queued frames have to follow,
+ * and ir_delay() has to wait for them before it uses Timer1.
+ * With IR_CHANNELS the frames go to another channel and are sent in the
+ * gaps of the hold, their slots are only freed when it ends.
+ *
+ * Build in the library directory with IR_TX_ASYNC and the flags of the PIC
+ * build, e.g.
+ *   gcc -O2 -DIR_HOST -DIR_TX_ASYNC -I. -o irhold host/hold.c IRremote.c
+ * Run
+ *   ./irhold
+ * Exits with 1 if a check fails, or if a call does not return.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "IRremote.h"
+
+#ifndef IR_TX_ASYNC
+#error "hold.c needs IR_TX_ASYNC"
+#endif
+
+#define FRAME_GAP     20000
+#define HEADER_MARK   8000  // NEC header mark, 9ms
+#define HEADER_SPACE  3375  // between the 4.5ms space of a frame and the 2.25ms of a repeat
+#define HOLD_US       500000UL
+
+static unsigned long last = 0;   // last carrier change
+static unsigned long markLen = 0;
+static unsigned char level = 0;
+static unsigned int frames = 0;  // full NEC frames
+static unsigned int repeats = 0; // NEC repeat frames
+static int failed = 0;
+
+// Counts the NEC frames and repeat frames the sender switches by their
+// header, queued frames may follow each other without a gap
+static void countOutput(unsigned char on, unsigned char khz) {
+  unsigned long now = ir_hostMicros();
+  (void)khz;
+  if (on == level) {
+    return;
+  }
+  if (!on) {
+    markLen = now - last;
+  }
+  else if (markLen > HEADER_MARK) {
+    if (now - last > HEADER_SPACE) {
+      frames++;
+    }
+    else {
+      repeats++;
+    }
+  }
+  last = now;
+  level = on;
+}
+
+static void expect(const char *what, long got, long want) {
+  printf("%-4s %-40s %ld (%ld)\n", got == want ? "ok" : "FAIL", what, got, want);
+  failed |= got != want;
+}
+
+int main(void) {
+  ir_code_t code;
+  ir_seqentry_t entry;
+  unsigned int queued = 0;
+
+  // a call that waits for the queue never returns during a hold
+  alarm(10);
+
+  code.decode_type = NEC;
+  code.value = 0x20DF10EFUL;
+  code.bits = 32;
+  code.address = 0;
+  entry.code = code;
+  entry.times = 1;
+  entry.gap = 50;
+
+  ir_hostSetOutput(countOutput);
+  expect("ir_holdStart()", ir_holdStart(&code), 1);
+  ir_hostRun(HOLD_US / 2);
+#if IR_CHANNELS > 1
+  ir_setChannel(1);
+#endif
+  // the hold has a slot, the others take one frame each
+  while (queued < IR_TXQUEUE && ir_sendCode(&code)) {
+    queued++;
+  }
+  expect("frames queued during the hold", queued, IR_TXQUEUE - 1);
+  expect("ir_sendCode() with all slots in use", ir_sendCode(&code), 0);
+  expect("ir_txWait()", ir_txWait(), 0);
+  expect("ir_delay()", ir_delay(1), 0);
+#ifdef IR_WAVECACHE
+  ir_clearCache();
+  expect("ir_sendCached() miss", ir_sendCached(&code), 0);
+#endif
+  expect("ir_holdStart() during the hold", ir_holdStart(&code), 0);
+  expect("ir_sendSequence() during the hold", ir_sendSequence(&entry, 1, 0), 0);
+  ir_hostRun(HOLD_US / 2);
+  printf("     %u frames and %u repeats during the hold\n", frames, repeats);
+#if IR_CHANNELS > 1
+  // the frames of the other channel are sent in the gaps
+  expect("frames during the hold", frames, 1 + queued);
+#else
+  expect("frames during the hold", frames, 1);
+#endif
+
+  ir_holdStop();
+  expect("ir_txWait() after ir_holdStop()", ir_txWait(), 1);
+  ir_hostRun(FRAME_GAP);
+  expect("frames sent", frames, 1 + queued);
+  expect("ir_sendCode() after the hold", ir_sendCode(&code), 1);
+  // ir_delay() only starts once the frame is out
+  expect("ir_delay() after ir_sendCode()", ir_delay(1), 1);
+  expect("frames sent after ir_sendCode()", frames, 2 + queued);
+  ir_hostSetOutput(0);
+  return failed;
+}
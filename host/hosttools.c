@@ -0,0 +1,148 @@
+/*
+ * Shared parts of the IRremote host tools, see hosttools.h
+ */
+
+// clock_gettime() is POSIX, not C99
+#define _POSIX_C_SOURCE 199309L
+
+#include <string.h>
+#include <time.h>
+
+#include "hosttools.h"
+
+const char *hostNames[HOST_TYPES] = {
+  "UNKNOWN", "", "NEC", "SONY", "RC5", "RC6", "DISH", "SHARP",
+  "PANASONIC", "JVC", "SANYO", "MITSUBISHI", "SIGMA"
+};
+
+const char *hostTypeName(int type) {
+  if (type < UNKNOWN || type > SIGMA) {
+    return "none";
+  }
+  return hostNames[type + 1];
+}
+
+// decode_type of a protocol name, UNKNOWN if there is none
+int hostTypeIndex(const char *name) {
+  int i;
+  for (i = 0; i < HOST_TYPES; i++) {
+    if (hostNames[i][0] && strcmp(name, hostNames[i]) == 0) {
+      return i - 1;
+    }
+  }
+  return UNKNOWN;
+}
+
+////////////////////////////////////////////////////////////
+// recording                                              //
+////////////////////////////////////////////////////////////
+
+hostframe_t hostParts[HOST_MAX_PARTS];
+int hostNparts = 0;
+static int hostRecType = UNKNOWN;
+static unsigned long hostRecOn = 0;  // time of the last carrier change
+static unsigned char hostRecLevel = 0;
+
+// Records the carrier of the sender as it switches, a long space starts
+// the next part
+static void hostRecordOutput(unsigned char on, unsigned char khz) {
+  unsigned long now = ir_hostMicros();
+  hostframe_t *part = hostNparts ? &hostParts[hostNparts - 1] : 0;
+  if (on == hostRecLevel) {
+    return;
+  }
+  if (on && (!part || now - hostRecOn > HOST_FRAME_GAP)) {
+    part = hostNparts < HOST_MAX_PARTS ? &hostParts[hostNparts++] : 0;
+    if (part) {
+      part->type = hostRecType;
+      part->len = 0;
+      part->khz = khz;
+      part->start = now;
+    }
+  }
+  else if (part && part->len < HOST_MAX_EDGES) {
+    part->us[part->len++] = now - hostRecOn;
+  }
+  hostRecOn = now;
+  hostRecLevel = on;
+}
+
+// Starts recording the carrier into hostParts, the parts get the type
+void hostRecordStart(int type) {
+  hostNparts = 0;
+  hostRecType = type;
+  ir_hostSetOutput(hostRecordOutput);
+}
+
+// Ends the recording after the last frame has ended, returns the parts
+int hostRecordStop(void) {
+#ifdef IR_TX_ASYNC
+  ir_txWait();
+#endif
+  ir_hostRun(HOST_FRAME_GAP * 2);
+  ir_hostSetOutput(0);
+  return hostNparts;
+}
+
+// Sends a code with ir_sendCode() and records it, returns the parts, 0 if
+// it was not sent
+int hostSend(int type, unsigned long value, int bits, unsigned int address) {
+  ir_code_t code;
+  int sent;
+  code.decode_type = type;
+  code.value = value;
+  code.bits = bits;
+  code.address = address;
+  hostRecordStart(type);
+  sent = ir_sendCode(&code);
+  hostRecordStop();
+  return sent ? hostNparts : 0;
+}
+
+// Turns a recorded carrier into the detector output the decoders expect:
+// marks get longer and spaces shorter by lag
+void hostAddLag(hostframe_t *f, unsigned int lag) {
+  int i;
+  for (i = 0; i < f->len; i++) {
+    if (i & 1) {
+      f->us[i] = f->us[i] > lag ? f->us[i] - lag : 0;
+    }
+    else {
+      f->us[i] += lag;
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////
+// replay                                                 //
+////////////////////////////////////////////////////////////
+
+// Plays detector output into the receiver: a gap, the frame and the gap
+// that ends it
+void hostPlay(const hostframe_t *f) {
+  int i;
+  ir_hostSetInput(IR_HOST_SPACE);
+  ir_hostRun(HOST_FRAME_GAP * 2);
+  for (i = 0; i < f->len; i++) {
+    ir_hostSetInput((i & 1) ? IR_HOST_SPACE : IR_HOST_MARK);
+    ir_hostRun(f->us[i]);
+  }
+  ir_hostSetInput(IR_HOST_SPACE);
+  ir_hostRun(HOST_FRAME_GAP * 2);
+}
+
+double hostNsNow(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// ir_match() calls of all decoders since ir_hostClearMatches()
+unsigned long hostMatchesNow(void) {
+  unsigned long sum = 0;
+  int type;
+  for (type = UNKNOWN; type <= SIGMA; type++) {
+    sum += ir_hostMatches(type);
+  }
+  return sum;
+}
@@ -0,0 +1,44 @@
+/*
+ * Shared parts of the IRremote host tools
+ *
+ * Each tool in this directory is built with IRremote.c and hosttools.c,
+ * see the comment at its top. hosttools.c holds what they have in common:
+ * the protocol names, recording the carrier of the library senders into
+ * frames and playing frames back as detector output into the simulated
+ * receiver (IR_HOST).
+ */
+
+#ifndef hosttools_h
+#define hosttools_h
+
+#include "IRremote.h"
+
+#define HOST_MAX_EDGES  (2 * RAWBUF)
+#define HOST_MAX_PARTS  8
+#define HOST_FRAME_GAP  10000 // a longer space splits a recording into frames
+#define HOST_LAG_US     100   // detector lag the decoders expect (MARK_EXCESS)
+#define HOST_TYPES      (SIGMA + 2) // decode_type + 1, UNKNOWN is 0 and 1 is not used
+
+typedef struct {
+  int type;                    // protocol of the frame, UNKNOWN if not known
+  int len;                     // entries in us
+  unsigned int us[HOST_MAX_EDGES]; // mark, space, mark ... in microseconds
+  unsigned char khz;           // carrier the sender set up
+  unsigned long start;         // virtual time of the first mark in microseconds
+} hostframe_t;
+
+extern const char *hostNames[HOST_TYPES];   // by decode_type + 1
+extern hostframe_t hostParts[HOST_MAX_PARTS]; // frames of the last recording
+extern int hostNparts;
+
+extern const char *hostTypeName(int type);
+extern int hostTypeIndex(const char *name);
+extern void hostRecordStart(int type);
+extern int hostRecordStop(void);
+extern int hostSend(int type, unsigned long value, int bits, unsigned int address);
+extern void hostAddLag(hostframe_t *f, unsigned int lag);
+extern void hostPlay(const hostframe_t *f);
+extern double hostNsNow(void);
+extern unsigned long hostMatchesNow(void);
+
+#endif
@@ -0,0 +1,380 @@
+/*
+ * IRremote noise test for the host
+ *
+ * Sends codes of every protocol the library can send, turns the carrier
+ * into the output of a modelled IR detector and replays that through the
+ * simulated receiver (IR_HOST), which samples it like the PIC does. Reports
+ * per noise level how many frames decode to the code of a clean replay and
+ * what the decoding costs.
+ *
+ * Detector model, applied to every frame in this order:
+ *   drift   the remote clock is off by this many percent, all durations
+ *           and the carrier scale with it
+ *   drop    probability that a mark is lost, it merges with its spaces
+ *   glitch  probability that a space gets a short mark in it, or a mark a
+ *           short space (50 to 250us)
+ *   lag     the detector ends a mark this many microseconds late
+ *   jitter  sigma in microseconds of the gaussian error of every edge
+ *   burst   probability that a burst starts at an edge; the next burstlen
+ *           edges get another gaussian error of sigma burstsigma
+ *
+ * Build in the library directory with the flags of the PIC build, e.g.
+ *   gcc -O2 -DIR_HOST -I. -o irnoise host/noise.c host/hosttools.c IRremote.c -lm
+ * Run
+ *   ./irnoise [-n codes] [-S seed] [-p name=value ...] [-s name=from:to:step]
+ * -p sets a model parameter, -s sweeps one. E.g. the jitter the decoders
+ * stand with another tolerance:
+ *   gcc -O2 -DIR_HOST -DTOLERANCE=30 -I. -o irnoise host/noise.c host/hosttools.c IRremote.c -lm
+ *   ./irnoise -s jitter=0:200:25
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hosttools.h"
+
+#define PI            3.14159265358979323846 // M_PI is not C99
+#define MAX_FRAMES    2048
+#define MAX_EDGES     HOST_MAX_EDGES
+#define GLITCH_MIN    50
+#define GLITCH_MAX    250
+#define PROTOCOLS     9
+
+typedef struct {
+  hostframe_t sent;            // carrier of the sender
+  ir_code_t ref;               // decode of the clean frame
+} frame_t;
+
+typedef struct {
+  const char *name;
+  double value;
+} param_t;
+
+enum { DRIFT, DROP, GLITCH, LAG, JITTER, BURST, BURSTLEN, BURSTSIGMA, PARAMS };
+
+static param_t params[PARAMS] = {
+  { "drift", 0 },
+  { "drop", 0 },
+  { "glitch", 0 },
+  { "lag", 100 },
+  { "jitter", 0 },
+  { "burst", 0 },
+  { "burstlen", 4 },
+  { "burstsigma", 150 }
+};
+
+static const int protocols[PROTOCOLS] = {
+  NEC, SONY, RC5, RC6, DISH, SHARP, PANASONIC, JVC, SIGMA
+};
+
+static frame_t frames[MAX_FRAMES];
+static int nframes = 0;
+
+////////////////////////////////////////////////////////////
+// random numbers                                         //
+////////////////////////////////////////////////////////////
+
+static unsigned long long seed = 88172645463325252ULL;
+
+static unsigned long rnd(void) {
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return (unsigned long)(seed >> 32);
+}
+
+static double uniform(void) {
+  return (rnd() + 0.5) / 4294967296.0;
+}
+
+static double gaussian(double sigma) {
+  return sigma * sqrt(-2 * log(uniform())) * cos(2 * PI * uniform());
+}
+
+////////////////////////////////////////////////////////////
+// frames                                                 //
+////////////////////////////////////////////////////////////
+
+// Records a code from the library sender, one frame per part
+static void addSent(int type, unsigned long value, int bits, unsigned int address) {
+  int i, n = hostSend(type, value, bits, address);
+  for (i = 0; i < n && nframes < MAX_FRAMES; i++) {
+    frames[nframes++].sent = hostParts[i];
+  }
+}
+
+static void buildFrames(int codes) {
+  static const int sonyBits[3] = { 12, 15, 20 };
+  int i;
+  for (i = 0; i < codes; i++) {
+    addSent(NEC, rnd(), 32, 0);
+    addSent(SONY, rnd() & 0xFFFFF, sonyBits[i % 3], 0);
+    addSent(RC5, rnd() & 0xFFF, 12, 0);
+    addSent(RC6, rnd() & 0xFFFFF, 20, 0);
+    addSent(DISH, rnd() & 0xFFFF, 16, 0);
+    addSent(SHARP, rnd() & 0x7FFF, 15, 0);
+    addSent(PANASONIC, rnd(), 48, (unsigned int)(rnd() & 0xFFFF));
+    addSent(JVC, rnd() & 0xFFFF, 16, 0);
+    addSent(SIGMA, rnd() & 0xFFFF, 16, 0);
+  }
+}
+
+////////////////////////////////////////////////////////////
+// detector model                                         //
+////////////////////////////////////////////////////////////
+
+// Edge times of the detector output for a frame, even edges start a mark
+static int model(const hostframe_t *f, const double *p, double *edge) {
+  double t = 0, d, at, len, glitchAt;
+  int i, n = 0, burst = 0, merge = 0;
+
+  for (i = 0; i < f->len && n < MAX_EDGES - 3; i++) {
+    d = f->us[i] * (1 + p[DRIFT] / 100);
+    if (merge) {
+      // space after a lost mark
+      merge = 0;
+      t += d;
+      continue;
+    }
+    if ((i & 1) == 0 && i > 0 && i + 1 < f->len && uniform() < p[DROP]) {
+      // lost mark, the spaces around it merge
+      merge = 1;
+      t += d;
+      continue;
+    }
+    if (uniform() < p[GLITCH]) {
+      len = GLITCH_MIN + uniform() * (GLITCH_MAX - GLITCH_MIN);
+      if (len < d - 2 * GLITCH_MIN) {
+        glitchAt = t + GLITCH_MIN + uniform() * (d - len - 2 * GLITCH_MIN);
+        edge[n++] = t;
+        edge[n++] = glitchAt;
+        edge[n++] = glitchAt + len;
+        t += d;
+        continue;
+      }
+    }
+    edge[n++] = t;
+    t += d;
+  }
+  edge[n++] = t;
+
+  for (i = 0; i < n; i++) {
+    at = edge[i];
+    if (i & 1) {
+      at += p[LAG];
+    }
+    if (p[JITTER] > 0) {
+      at += gaussian(p[JITTER]);
+    }
+    if (burst == 0 && p[BURST] > 0 && uniform() < p[BURST]) {
+      burst = (int)p[BURSTLEN];
+    }
+    if (burst > 0) {
+      at += gaussian(p[BURSTSIGMA]);
+      burst--;
+    }
+    edge[i] = at;
+  }
+
+  // edges that cross remove the pulse between them
+  for (i = 1; i < n; i++) {
+    if (edge[i] <= edge[i - 1]) {
+      memmove(&edge[i - 1], &edge[i + 1], (n - i - 1) * sizeof(edge[0]));
+      n -= 2;
+      i = i > 1 ? i - 2 : 0;
+    }
+  }
+  if (n > 0 && edge[0] < 0) {
+    for (i = n - 1; i >= 0; i--) {
+      edge[i] -= edge[0];
+    }
+  }
+  return n;
+}
+
+////////////////////////////////////////////////////////////
+// replay                                                 //
+////////////////////////////////////////////////////////////
+
+typedef struct {
+  unsigned long frames;
+  unsigned long ok;
+  unsigned long lost;     // nothing the decoders could use
+  unsigned long decodes;
+  unsigned long matches;
+  double ns;
+} tally_t;
+
+// Plays the detector output of a frame into the receiver and decodes it.
+// A frame the receiver splits queues several, the longest one counts.
+static void replay(const hostframe_t *f, const double *p, ir_code_t *got, tally_t *tally) {
+  static double edge[MAX_EDGES];
+  decode_results res;
+  unsigned long us, done = 0;
+  double start;
+  int i, n, frame, rawlen = 0;
+
+  n = model(f, p, edge);
+  ir_hostSetInput(IR_HOST_SPACE);
+  ir_hostRun(HOST_FRAME_GAP * 2);
+  for (i = 0; i < n; i++) {
+    us = (unsigned long)(edge[i] + 0.5);
+    ir_hostRun(us - done);
+    done = us;
+    ir_hostSetInput((i & 1) ? IR_HOST_SPACE : IR_HOST_MARK);
+  }
+  ir_hostSetInput(IR_HOST_SPACE);
+  ir_hostRun(HOST_FRAME_GAP * 2);
+
+  got->decode_type = UNKNOWN - 1;
+  for (frame = 0; frame < RAWFRAMES; frame++) {
+    ir_hostClearMatches();
+    start = hostNsNow();
+    if (!ir_decode(&res)) {
+      continue;
+    }
+    tally->ns += hostNsNow() - start;
+    tally->matches += hostMatchesNow();
+    tally->decodes++;
+    if (res.rawlen > rawlen) {
+      rawlen = res.rawlen;
+      got->decode_type = res.decode_type;
+      got->value = res.value;
+      got->bits = res.bits;
+      got->address = res.panasonicAddress;
+    }
+    ir_resume();
+  }
+}
+
+static int same(const ir_code_t *a, const ir_code_t *b) {
+  return a->decode_type == b->decode_type && a->value == b->value && a->bits == b->bits &&
+         (a->decode_type != PANASONIC || a->address == b->address);
+}
+
+// Runs all frames at one noise level, prints a line
+static void level(double *p, int sweep) {
+  tally_t tally[PROTOCOLS], all;
+  ir_code_t got;
+  int i, k;
+
+  memset(tally, 0, sizeof(tally));
+  memset(&all, 0, sizeof(all));
+  for (i = 0; i < nframes; i++) {
+    for (k = 0; k < PROTOCOLS && protocols[k] != frames[i].sent.type; k++)
+      ;
+    replay(&frames[i].sent, p, &got, &tally[k]);
+    tally[k].frames++;
+    tally[k].ok += same(&got, &frames[i].ref);
+    tally[k].lost += got.decode_type < UNKNOWN;
+  }
+
+  if (sweep >= 0) {
+    printf("%10g", p[sweep]);
+  }
+  for (k = 0; k < PROTOCOLS; k++) {
+    printf(" %9.1f", tally[k].frames ? 100.0 * tally[k].ok / tally[k].frames : 0);
+    all.frames += tally[k].frames;
+    all.ok += tally[k].ok;
+    all.lost += tally[k].lost;
+    all.decodes += tally[k].decodes;
+    all.matches += tally[k].matches;
+    all.ns += tally[k].ns;
+  }
+  printf(" %7.1f %6.1f %7.1f %6.0f\n", 100.0 * all.ok / all.frames, 100.0 * all.lost / all.frames,
+         all.decodes ? (double)all.matches / all.decodes : 0, all.decodes ? all.ns / all.decodes : 0);
+}
+
+static int paramIndex(const char *name) {
+  int i;
+  for (i = 0; i < PARAMS; i++) {
+    if (strcmp(name, params[i].name) == 0) {
+      return i;
+    }
+  }
+  fprintf(stderr, "unknown parameter %s\n", name);
+  exit(1);
+}
+
+static void usage(void) {
+  int i;
+  fprintf(stderr, "usage: irnoise [-n codes] [-S seed] [-p name=value ...] [-s name=from:to:step]\nparameters:");
+  for (i = 0; i < PARAMS; i++) {
+    fprintf(stderr, " %s=%g", params[i].name, params[i].value);
+  }
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  double p[PARAMS], clean[PARAMS], from = 0, to = 0, step = 1, x;
+  int codes = 16, sweep = -1, i;
+  ir_code_t got;
+  tally_t unused;
+  char *eq;
+
+  for (i = 0; i < PARAMS; i++) {
+    p[i] = params[i].value;
+  }
+  for (i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      usage();
+    }
+    if (strcmp(argv[i], "-n") == 0) {
+      codes = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-S") == 0) {
+      seed = strtoull(argv[++i], 0, 0) | 1;
+    }
+    else if (strcmp(argv[i], "-p") == 0 && (eq = strchr(argv[++i], '='))) {
+      *eq = 0;
+      p[paramIndex(argv[i])] = atof(eq + 1);
+    }
+    else if (strcmp(argv[i], "-s") == 0 && (eq = strchr(argv[++i], '='))) {
+      *eq = 0;
+      sweep = paramIndex(argv[i]);
+      if (sscanf(eq + 1, "%lf:%lf:%lf", &from, &to, &step) != 3 || step <= 0) {
+        usage();
+      }
+    }
+    else {
+      usage();
+    }
+  }
+
+  ir_enableIRIn();
+  ir_hostRun(HOST_FRAME_GAP * 2);
+  buildFrames(codes);
+
+  // what the frames decode to without noise and with the lag the decoders expect
+  for (i = 0; i < PARAMS; i++) {
+    clean[i] = params[i].value;
+  }
+  memset(&unused, 0, sizeof(unused));
+  for (i = 0; i < nframes; i++) {
+    replay(&frames[i].sent, clean, &got, &unused);
+    frames[i].ref = got;
+  }
+
+  printf("%d frames, decoded as without noise in percent\n", nframes);
+  if (sweep >= 0) {
+    printf("%10s", params[sweep].name);
+  }
+  for (i = 0; i < PROTOCOLS; i++) {
+    printf(" %9s", hostTypeName(protocols[i]));
+  }
+  printf(" %7s %6s %7s %6s\n", "all", "lost", "matches", "ns");
+  if (sweep < 0) {
+    level(p, -1);
+    return 0;
+  }
+  for (x = from; x <= to + step / 2; x += step) {
+    p[sweep] = x;
+    level(p, sweep);
+  }
+  return 0;
+}
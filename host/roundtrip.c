@@ -0,0 +1,167 @@
+/*
+ * IRremote send, capture and decode round trip for the host
+ *
+ * Sends codes of every protocol through the library senders, records the
+ * carrier they switch (IR_HOST), plays it back as detector output with the
+ * lag the decoders expect (MARK_EXCESS) into the simulated receiver and
+ * checks that ir_decode() returns the code sent: type, value, bits and the
+ * Panasonic address. Protocols without a decoder (DISH, Sharp) are only
+ * checked for timing.
+ *
+ * For every frame it compares the captured durations with the sent ones
+ * and reports the error per edge: measured minus sent, less the lag.
+ *
+ * Build in the library directory with the flags of the PIC build, e.g.
+ *   gcc -O2 -DIR_HOST -I. -o irroundtrip host/roundtrip.c host/hosttools.c IRremote.c
+ * Run
+ *   ./irroundtrip [-v]
+ * -v prints every edge. Exits with 1 if a code does not come back.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hosttools.h"
+
+#define TICK_US       50    // rawbuf unit
+
+typedef struct {
+  int type;
+  unsigned long value;
+  int bits;
+  unsigned int address;
+  int decodes;                 // 0 if the library has no decoder for it
+} case_t;
+
+static const case_t cases[] = {
+  { NEC, 0x20DF10EFUL, 32, 0, 1 },
+  { NEC, 0x00000000UL, 32, 0, 1 },
+  { NEC, 0xFFFFFFFEUL, 32, 0, 1 },
+  { NEC, REPEAT, 0, 0, 1 },
+  { SONY, 0xA90, 12, 0, 1 },
+  { SONY, 0x5A5A, 15, 0, 1 },
+  { SONY, 0xFFFFF, 20, 0, 1 },
+  { RC5, 0x80C, 12, 0, 1 },
+  { RC5, 0xFFF, 12, 0, 1 },
+  { RC6, 0xC800F, 20, 0, 1 },
+  { RC6, 0x00001, 20, 0, 1 },
+  { PANASONIC, 0x0100BCBDUL, 48, 0x4004, 1 },
+  { PANASONIC, 0xFFFFFFFFUL, 48, 0x0000, 1 },
+  { JVC, 0xC5E8, 16, 0, 1 },
+  { JVC, 0x0001, 16, 0, 1 },
+  { SIGMA, 0x1234, 16, 0, 1 },
+  { SIGMA, 0xFFFF, 16, 0, 1 },
+  { DISH, 0x1C3E, 16, 0, 0 },
+  { SHARP, 0x41B8, 15, 0, 0 }
+};
+
+#define CASES (sizeof(cases) / sizeof(cases[0]))
+
+static int verbose = 0;
+
+// Plays a part back as detector output with the sensor lag
+static void play(const hostframe_t *part) {
+  static hostframe_t lagged;
+  lagged = *part;
+  hostAddLag(&lagged, HOST_LAG_US);
+  hostPlay(&lagged);
+}
+
+typedef struct {
+  long sum[2];                 // per mark (0) and space (1)
+  long worst[2];
+  int edges[2];
+} timing_t;
+
+// Compares the durations of a captured frame with the sent ones from
+// entry at of the part on
+static void compare(const hostframe_t *part, const unsigned int *ticks, int len, int at, timing_t *t) {
+  long err;
+  int i, k;
+  for (i = 0; i < len && at + i < part->len; i++) {
+    k = (at + i) & 1;
+    err = (long)ticks[i] * TICK_US - part->us[at + i] - (k ? -HOST_LAG_US : HOST_LAG_US);
+    t->sum[k] += err;
+    t->edges[k]++;
+    if (labs(err) > labs(t->worst[k])) {
+      t->worst[k] = err;
+    }
+    if (verbose) {
+      printf("    %3d %-5s sent %5u us, captured %5u us, error %+4ld us\n", at + i, k ? "space" : "mark",
+             part->us[at + i], ticks[i] * TICK_US, err);
+    }
+  }
+}
+
+static int check(const case_t *c) {
+  decode_results res;
+  timing_t t;
+  static unsigned int ticks[RAWFRAMES][RAWBUF];
+  int lens[RAWFRAMES];
+  int p, i, frame, nframes, nparts, end, ok, found = 0;
+
+  nparts = hostSend(c->type, c->value, c->bits, c->address);
+
+  memset(&t, 0, sizeof(t));
+  for (p = 0; p < nparts; p++) {
+    play(&hostParts[p]);
+    nframes = 0;
+    for (frame = 0; frame < RAWFRAMES; frame++) {
+      if (!ir_decode(&res)) {
+        continue;
+      }
+      if (res.decode_type == c->type && res.value == c->value && res.bits == c->bits &&
+          (c->type != PANASONIC || res.panasonicAddress == c->address)) {
+        found = 1;
+      }
+      else if (verbose || c->decodes) {
+        printf("  part %d decoded %s value %lX bits %d address %X\n", p, hostTypeName(res.decode_type),
+               res.value, res.bits, res.panasonicAddress);
+      }
+      lens[nframes] = res.rawlen - 1;
+      for (i = 1; i < res.rawlen; i++) {
+        ticks[nframes][i - 1] = ir_rawAt(&res, i);
+      }
+      nframes++;
+      ir_resume();
+    }
+    // A space longer than the receiver gap splits a part, and a piece too
+    // short for the hash is thrown away. The last frame ends where the
+    // part does, each one before it ends before the space that split it.
+    end = hostParts[p].len;
+    for (frame = nframes - 1; frame >= 0; frame--) {
+      end -= lens[frame];
+      compare(&hostParts[p], ticks[frame], lens[frame], end, &t);
+      end--;
+    }
+  }
+
+  ok = found || !c->decodes;
+  printf("%-4s %-10s %8lX %2d %5d", ok ? "ok" : "FAIL", hostTypeName(c->type), c->value, c->bits, nparts);
+  if (t.edges[0]) {
+    printf("  mark %+6.1f %+4ld", (double)t.sum[0] / t.edges[0], t.worst[0]);
+  }
+  if (t.edges[1]) {
+    printf("  space %+6.1f %+4ld", (double)t.sum[1] / t.edges[1], t.worst[1]);
+  }
+  printf("%s\n", c->decodes ? "" : "  (no decoder)");
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  unsigned int i, failed = 0;
+  if (argc > 1 && strcmp(argv[1], "-v") == 0) {
+    verbose = 1;
+  }
+
+  ir_enableIRIn();
+  ir_hostRun(HOST_FRAME_GAP * 2);
+  printf("     %-10s %8s %2s %5s  %-17s  %-17s\n", "protocol", "value", "n", "parts",
+         "mark mean worst", "space mean worst");
+  for (i = 0; i < CASES; i++) {
+    failed += !check(&cases[i]);
+  }
+  printf("%u of %u codes failed\n", failed, (unsigned int)CASES);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,228 @@
+/*
+ * IRremote receive ring stress test for the host
+ *
+ * Plays a long stream of NEC frames with random values and short random
+ * gaps into the simulated receiver (IR_HOST). Between the edges a consumer
+ * takes frames with ir_decode() and hands them back with ir_resume() at
+ * random times, holding each one while the ISR goes on recording into the
+ * other slots. Each pass runs the consumer at another speed, from faster
+ * than the frames arrive to much slower, so the RAWFRAMES slots run full.
+ *
+ * It checks that
+ *   - the frames come back in the order they were sent, none twice, and
+ *     every one decodes to the value sent
+ *   - a frame that is held does not change while later frames arrive
+ *   - every frame that does not come back is counted by
+ *     ir_getOverflowCount(), and ir_getFramesPeak() stays within RAWFRAMES
+ *
+ * Build in the library directory with the flags of the PIC build, e.g.
+ *   gcc -O2 -DIR_HOST -I. -o irstress host/stress.c host/hosttools.c IRremote.c
+ * Run
+ *   ./irstress [-n frames] [-S seed]
+ * Exits with 1 if a check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hosttools.h"
+
+#define MAX_FRAMES    20000
+#define GAP_MIN       6000  // gaps between the frames, longer than the receiver gap
+#define GAP_MAX       12000
+
+typedef struct {
+  const char *name;
+  unsigned int take;           // chance per edge in 1/1000 that a frame is taken
+  unsigned int release;        // chance per edge in 1/1000 that it is handed back
+} pass_t;
+
+static const pass_t passes[] = {
+  { "fast", 1000, 1000 },
+  { "even", 40, 40 },
+  { "slow", 10, 5 },
+  { "stall", 2, 1 }
+};
+
+#define PASSES (sizeof(passes) / sizeof(passes[0]))
+
+static unsigned long values[MAX_FRAMES];
+static hostframe_t frame;
+
+////////////////////////////////////////////////////////////
+// random numbers                                         //
+////////////////////////////////////////////////////////////
+
+static unsigned long long seed = 88172645463325252ULL;
+
+static unsigned long rnd(void) {
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return (unsigned long)(seed >> 32);
+}
+
+////////////////////////////////////////////////////////////
+// consumer                                               //
+////////////////////////////////////////////////////////////
+
+typedef struct {
+  const pass_t *pass;
+  int sent;                    // frames played completely
+  int next;                    // oldest sent frame that has not come back
+  int decoded;                 // frames that came back
+  int lost;                    // frames skipped by the ones that came back
+  int errors;
+  int holding;                 // res is a frame taken with ir_decode()
+  decode_results res;
+  unsigned int snap[RAWBUF];   // its entries when it was taken
+} consumer_t;
+
+static void fail(consumer_t *c, const char *what) {
+  if (c->errors++ < 5) {
+    printf("  %s: %s at frame %d\n", c->pass->name, what, c->sent);
+  }
+}
+
+// Takes the oldest frame and checks it against the ones sent
+static void take(consumer_t *c) {
+  int i;
+  if (!ir_decode(&c->res)) {
+    return;
+  }
+  if (c->res.decode_type != NEC || c->res.bits != NEC_BITS) {
+    fail(c, "frame does not decode");
+  }
+  else {
+    for (i = c->next; i < c->sent && values[i] != c->res.value; i++) {
+    }
+    if (i == c->sent) {
+      fail(c, "value not sent or out of order");
+    }
+    else {
+      c->lost += i - c->next;
+      c->next = i + 1;
+    }
+  }
+  c->decoded++;
+  for (i = 0; i < c->res.rawlen; i++) {
+    c->snap[i] = ir_rawAt(&c->res, i);
+  }
+  c->holding = 1;
+}
+
+// Checks that the frame held did not change and hands it back
+static void release(consumer_t *c) {
+  int i;
+  for (i = 0; i < c->res.rawlen; i++) {
+    if (c->snap[i] != ir_rawAt(&c->res, i)) {
+      fail(c, "frame changed while it was held");
+      break;
+    }
+  }
+  c->holding = 0;
+  ir_resume();
+}
+
+static void consume(consumer_t *c) {
+  if (c->holding) {
+    if (rnd() % 1000 < c->pass->release) {
+      release(c);
+    }
+  }
+  else if (rnd() % 1000 < c->pass->take) {
+    take(c);
+  }
+}
+
+////////////////////////////////////////////////////////////
+// passes                                                 //
+////////////////////////////////////////////////////////////
+
+// Plays the frames and lets the consumer run between the edges
+static int run(const pass_t *pass, int n) {
+  consumer_t c;
+  int i, k;
+  unsigned int overflows;
+
+  memset(&c, 0, sizeof(c));
+  c.pass = pass;
+  ir_resetOverflowCount();
+  for (i = 0; i < n; i++) {
+    if (hostSend(NEC, values[i], NEC_BITS, 0) != 1) {
+      printf("  %s: frame %d was not recorded\n", pass->name, i);
+      return 0;
+    }
+    frame = hostParts[0];
+    hostAddLag(&frame, HOST_LAG_US);
+    ir_hostSetInput(IR_HOST_SPACE);
+    ir_hostRun(GAP_MIN + rnd() % (GAP_MAX - GAP_MIN));
+    for (k = 0; k < frame.len; k++) {
+      ir_hostSetInput((k & 1) ? IR_HOST_SPACE : IR_HOST_MARK);
+      // the consumer runs in the middle of each mark and space
+      ir_hostRun(frame.us[k] / 2);
+      consume(&c);
+      ir_hostRun(frame.us[k] - frame.us[k] / 2);
+    }
+    ir_hostSetInput(IR_HOST_SPACE);
+    c.sent++;
+    consume(&c);
+  }
+  // let the last frame end and take all that are left
+  ir_hostRun(HOST_FRAME_GAP * 2);
+  if (c.holding) {
+    release(&c);
+  }
+  while (1) {
+    take(&c);
+    if (!c.holding) {
+      break;
+    }
+    release(&c);
+  }
+  c.lost += c.sent - c.next;
+
+  overflows = ir_getOverflowCount();
+  if ((unsigned int)c.lost != overflows) {
+    fail(&c, "lost frames are not counted as overflows");
+  }
+  if (ir_getFramesPeak() > RAWFRAMES) {
+    fail(&c, "more frames waiting than RAWFRAMES");
+  }
+  printf("%-4s %-6s %6d %8d %6d %9u %5u\n", c.errors ? "FAIL" : "ok", pass->name, c.sent, c.decoded,
+         c.lost, overflows, (unsigned int)ir_getFramesPeak());
+  return c.errors == 0;
+}
+
+int main(int argc, char **argv) {
+  unsigned int p;
+  int i, n = 2000, failed = 0;
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      n = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+      seed = strtoull(argv[++i], 0, 0) | 1;
+    }
+    else {
+      fprintf(stderr, "usage: irstress [-n frames] [-S seed]\n");
+      return 2;
+    }
+  }
+  if (n < 1 || n > MAX_FRAMES) {
+    n = MAX_FRAMES;
+  }
+  for (i = 0; i < n; i++) {
+    values[i] = rnd();
+  }
+
+  ir_enableIRIn();
+  ir_hostRun(HOST_FRAME_GAP * 2);
+  printf("     %-6s %6s %8s %6s %9s %5s\n", "pass", "sent", "decoded", "lost", "overflows", "peak");
+  for (p = 0; p < PASSES; p++) {
+    failed += !run(&passes[p], n);
+  }
+  printf("%d of %u passes failed (RAWFRAMES %d)\n", failed, (unsigned int)PASSES, RAWFRAMES);
+  return failed ? 1 : 0;
+}
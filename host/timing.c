@@ -0,0 +1,292 @@
+/*
+ * IRremote send and receive timing for the host
+ *
+ * Sends a code of every protocol through the library senders, records the
+ * carrier (IR_HOST) and plays it back as detector output with the lag the
+ * decoders expect into the simulated receiver of the backend the library
+ * is built with (IR_RX_BACKEND). For every frame it reports
+ *   isr     interrupts the receiver took from the first to the last edge
+ *   mark, space  error of the captured durations against the played
+ *           ones, mean and worst, in microseconds
+ *   ready   time from the last edge until ir_decode() returns the frame,
+ *           the receiver ends a frame after a 5ms gap, with
+ *           IR_STREAM_DECODE NEC, Sigma and Panasonic at their stop mark,
+ *           with IR_EARLY_END by the rule of their header
+ *   end     how the receiver ended it, decode_results.endReason
+ * and how many interrupts the idle receiver takes per second. The polling
+ * backend samples every 50us, the edge backend only interrupts at the
+ * edges of the detector output and timestamps them.
+ *
+ * For the sender it reports per frame
+ *   length  from the start of the first mark to the end of the last one
+ *   error   of the length against the durations of the protocol, and the
+ *           worst error of a mark or space
+ *   carrier the frequency in Hz and duty cycle in percent Timer2 and CCP1
+ *           are set up for, and the error of the frequency against the one
+ *           the protocol asks for
+ * The host Timer1 loses HOST_T1_WRITE_CYCLES per write like the PIC, and
+ * DELAY_ADD_TICKS makes up for them. Build with -DDELAY_ADD_TICKS=0 for the
+ * error without it, or with -DHOST_T1_READ_CYCLES=1 to 3 for the part of a
+ * tick the prescaler loses when the read is not right at a tick.
+ *
+ * Build in the library directory with the flags of the PIC build, e.g.
+ *   gcc -O2 -DIR_HOST -I. -o irtiming host/timing.c host/hosttools.c IRremote.c
+ *   gcc -O2 -DIR_HOST -DIR_RX_BACKEND=IR_RX_EDGE -I. -o irtiming host/timing.c host/hosttools.c IRremote.c
+ * Run
+ *   ./irtiming
+ * Exits with 1 if a code does not decode, a duration is off by more than a
+ * receiver tick, a frame is not ready as early as the options promise, a
+ * sent frame is off by a microsecond or more, or its carrier by more than
+ * 1% in frequency or duty cycle (IR_DUTY).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hosttools.h"
+
+#define TICK_US       50    // rawbuf unit
+#define IDLE_US       1000000UL
+#define READY_US      (2 * TICK_US) // at the stop mark, one tick to notice it
+
+// the Timer1 model of the build, as IRremoteHost.h sets it up
+#ifndef HOST_T1_READ_CYCLES
+#define HOST_T1_READ_CYCLES 0
+#endif
+#ifndef HOST_T1_WRITE_CYCLES
+#define HOST_T1_WRITE_CYCLES 8
+#endif
+#ifndef DELAY_ADD_TICKS
+#define DELAY_ADD_TICKS 2
+#endif
+
+typedef struct {
+  int type;
+  unsigned long value;
+  int bits;
+  unsigned int address;
+  unsigned long streams;       // decoded in the ISR with IR_STREAM_DECODE, ready after at most us
+  unsigned long early;         // ready with IR_EARLY_END after at most us, 0 at the gap
+} case_t;
+
+// the protocols with a decoder
+static const case_t cases[] = {
+  { NEC, 0x20DF10EFUL, 32, 0, READY_US, READY_US },
+  { NEC, REPEAT, 0, 0, READY_US, READY_US },
+  { SONY, 0xA90, 12, 0, 0, 0 },
+  { RC5, 0x80C, 12, 0, 0, 0 },
+  { RC6, 0xC800F, 20, 0, 0, 0 },
+  { PANASONIC, 0x0100BCBDUL, 48, 0x4004, READY_US, READY_US },
+  { JVC, 0xC5E8, 16, 0, 2000, 2000 },  // its header is also NEC's, NEC still takes its next space
+  { SIGMA, 0x1234, 16, 0, READY_US, 2000 }    // the space between its bytes is long
+};
+
+#define CASES (sizeof(cases) / sizeof(cases[0]))
+
+// all protocols the library sends
+static const case_t sends[] = {
+  { NEC, 0x20DF10EFUL, 32, 0, READY_US, READY_US },
+  { NEC, REPEAT, 0, 0, READY_US, READY_US },
+  { SONY, 0xA90, 12, 0, 0, 0 },
+  { RC5, 0x80C, 12, 0, 0, 0 },
+  { RC6, 0xC800F, 20, 0, 0, 0 },
+  { PANASONIC, 0x0100BCBDUL, 48, 0x4004, READY_US, READY_US },
+  { JVC, 0xC5E8, 16, 0, 2000, 2000 },
+  { SIGMA, 0x1234, 16, 0, READY_US, 2000 },
+  { DISH, 0x1C3E, 16, 0, 0, 0 },
+  { SHARP, 0x41B8, 15, 0, 0, 0 }
+};
+
+#define SENDS (sizeof(sends) / sizeof(sends[0]))
+
+static const char *endNames[] = { "", "gap", "full", "count", "stream" };
+
+// Durations of the protocols in IRremoteInt.h, and the sums of the ones
+// that follow each other without an edge (RC5, RC6)
+static const unsigned int nominalNEC[] = { 9000, 4500, 560, 1600, 2250, 0 };
+static const unsigned int nominalSony[] = { 2400, 600, 1200, 0 };
+static const unsigned int nominalRC5[] = { 889, 1778, 0 };
+static const unsigned int nominalRC6[] = { 2666, 889, 444, 888, 1332, 1776, 0 };
+static const unsigned int nominalPanasonic[] = { 3502, 1750, 502, 1244, 400, 0 };
+static const unsigned int nominalJVC[] = { 8000, 4000, 600, 1600, 550, 0 };
+static const unsigned int nominalSigma[] = { 8440, 4240, 520, 1600, 0 };
+static const unsigned int nominalDish[] = { 400, 6100, 1700, 2800, 0 };
+static const unsigned int nominalSharp[] = { 245, 1805, 795, 0 };
+
+static const unsigned int *nominal(int type) {
+  switch (type) {
+    case NEC: return nominalNEC;
+    case SONY: return nominalSony;
+    case RC5: return nominalRC5;
+    case RC6: return nominalRC6;
+    case PANASONIC: return nominalPanasonic;
+    case JVC: return nominalJVC;
+    case DISH: return nominalDish;
+    case SHARP: return nominalSharp;
+    default: return nominalSigma;
+  }
+}
+
+typedef struct {
+  long sum[2];                 // per mark (0) and space (1)
+  long worst[2];
+  int edges[2];
+} timing_t;
+
+static hostframe_t played;
+
+// Plays the frame up to its last edge, returns the interrupts from its
+// first to its last edge
+static unsigned long play(const hostframe_t *f) {
+  unsigned long isrs;
+  int i;
+  ir_hostSetInput(IR_HOST_SPACE);
+  ir_hostRun(HOST_FRAME_GAP * 2);
+  isrs = ir_hostInterrupts();
+  for (i = 0; i < f->len; i++) {
+    ir_hostSetInput((i & 1) ? IR_HOST_SPACE : IR_HOST_MARK);
+    ir_hostRun(f->us[i]);
+  }
+  ir_hostSetInput(IR_HOST_SPACE);
+  return ir_hostInterrupts() - isrs;
+}
+
+// Compares the captured durations with the played ones, the frame has to
+// be captured whole
+static void compare(decode_results *res, timing_t *t) {
+  long err;
+  int i, k;
+  for (i = 0; i + 1 < res->rawlen && i < played.len; i++) {
+    k = i & 1;
+    err = (long)ir_rawAt(res, i + 1) * TICK_US - (long)played.us[i];
+    t->sum[k] += err;
+    t->edges[k]++;
+    if (labs(err) > labs(t->worst[k])) {
+      t->worst[k] = err;
+    }
+  }
+}
+
+static int check(const case_t *c) {
+  decode_results res;
+  timing_t t;
+  unsigned long isrs, start, ready = 0;
+  int found = 0, end = 0, ok, k;
+
+  if (!hostSend(c->type, c->value, c->bits, c->address)) {
+    printf("FAIL %-10s not sent\n", hostTypeName(c->type));
+    return 0;
+  }
+  // the first frame, Sony and others send more
+  played = hostParts[0];
+  hostAddLag(&played, HOST_LAG_US);
+  memset(&t, 0, sizeof(t));
+  isrs = play(&played);
+  // the application asks for the frame every tick
+  start = ir_hostMicros();
+  while (ir_hostMicros() - start < HOST_FRAME_GAP * 2) {
+    ir_hostRun(TICK_US);
+    if (!ir_decode(&res)) {
+      continue;
+    }
+    if (!found && res.decode_type == c->type && res.value == c->value && res.bits == c->bits &&
+        res.rawlen == played.len + 1) {
+      found = 1;
+      ready = ir_hostMicros() - start;
+      end = res.endReason;
+      compare(&res, &t);
+    }
+    ir_resume();
+  }
+
+  ok = found;
+  for (k = 0; k < 2; k++) {
+    ok = ok && labs(t.worst[k]) <= TICK_US;
+  }
+#ifdef IR_STREAM_DECODE
+  ok = ok && (!c->streams || (ready <= c->streams && end == IR_END_STREAM));
+#endif
+#ifdef IR_EARLY_END
+  ok = ok && (!c->early || ready <= c->early);
+#endif
+  printf("%-4s %-10s %8lX %5d %5lu", ok ? "ok" : "FAIL", hostTypeName(c->type), c->value, played.len, isrs);
+  for (k = 0; k < 2; k++) {
+    if (t.edges[k]) {
+      printf("  %+6.1f %+4ld", (double)t.sum[k] / t.edges[k], t.worst[k]);
+    }
+    else {
+      printf("  %12s", "");
+    }
+  }
+  printf("  %5lu %s\n", ready, end >= 0 && end <= IR_END_STREAM ? endNames[end] : "?");
+  return ok;
+}
+
+// Compares the length and carrier of the first frame sent with the
+// nominal ones
+static int checkSend(const case_t *c) {
+  const unsigned int *durations = nominal(c->type);
+  unsigned long length = 0, hz;
+  long err, sum = 0, worst = 0, hzErr;
+  unsigned int duty;
+  int i, k, ok;
+  unsigned int best;
+
+  if (!hostSend(c->type, c->value, c->bits, c->address)) {
+    printf("FAIL %-10s not sent\n", hostTypeName(c->type));
+    return 0;
+  }
+  for (i = 0; i < hostParts[0].len; i++) {
+    // the nominal duration is the one closest to the sent one
+    best = durations[0];
+    for (k = 1; durations[k]; k++) {
+      if (labs((long)hostParts[0].us[i] - (long)durations[k]) < labs((long)hostParts[0].us[i] - (long)best)) {
+        best = durations[k];
+      }
+    }
+    err = (long)hostParts[0].us[i] - (long)best;
+    length += hostParts[0].us[i];
+    sum += err;
+    if (labs(err) > labs(worst)) {
+      worst = err;
+    }
+  }
+  hz = ir_hostCarrierHz();
+  duty = ir_hostCarrierDuty();
+  hzErr = (long)hz - hostParts[0].khz * 1000L;
+  ok = sum == 0 && labs(hzErr) * 100 <= hostParts[0].khz * 1000L &&
+       labs((long)duty - IR_DUTY * 10L) <= 10;
+  printf("%-4s %-10s %8lX %5d %7lu %+6ld %+5ld  %3u %6lu %+5.2f%% %4.1f%%\n", ok ? "ok" : "FAIL",
+         hostTypeName(c->type), c->value, hostParts[0].len, length, sum, worst, hostParts[0].khz, hz,
+         hzErr * 100.0 / (hostParts[0].khz * 1000.0), duty / 10.0);
+  return ok;
+}
+
+int main(void) {
+  unsigned int i, failed = 0;
+  unsigned long isrs;
+
+  ir_enableIRIn();
+  ir_hostRun(HOST_FRAME_GAP * 2);
+  isrs = ir_hostInterrupts();
+  ir_hostRun(IDLE_US);
+  isrs = ir_hostInterrupts() - isrs;
+  printf("%s receiver, %lu interrupts per second while idle\n",
+         IR_RX_BACKEND == IR_RX_EDGE ? "edge" : "polling", isrs * (1000000UL / IDLE_US));
+  printf("     %-10s %8s %5s %5s  %-12s  %-12s  %5s %s\n", "protocol", "value", "edges", "isr",
+         "mark  worst", "space worst", "ready", "end");
+  for (i = 0; i < CASES; i++) {
+    failed += !check(&cases[i]);
+  }
+
+  printf("\nsender, Timer1 writes %d cycles after the read, %d cycles into a tick, "
+         "and makes up for %d ticks\n", HOST_T1_WRITE_CYCLES, HOST_T1_READ_CYCLES, DELAY_ADD_TICKS);
+  printf("     %-10s %8s %5s %7s %6s %5s  %3s %6s %6s %5s\n", "protocol", "value", "edges", "length",
+         "error", "worst", "kHz", "Hz", "error", "duty");
+  for (i = 0; i < SENDS; i++) {
+    failed += !checkSend(&sends[i]);
+  }
+  printf("%u of %u checks failed\n", failed, (unsigned int)(CASES + SENDS));
+  return failed ? 1 : 0;
+}